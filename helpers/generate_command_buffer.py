@@ -0,0 +1,117 @@
+# Generates the code to execute commands recorded in a buffer (see `execute_commands`):
+# - a C++ header that decodes the arguments of each command, calls the plugin
+#   and encodes its results,
+# - a Lua table that describes the arguments and results of each command, used by
+#   simAsebaCommands.lua to encode and decode the buffers.
+# Commands are identified by their index in callbacks.xml.
+
+import argparse
+import os
+import xml.etree.ElementTree as ET
+
+EXCLUDED = ['execute_commands']
+
+CPP_HEADER = """// Generated by helpers/generate_command_buffer.py: do not edit
+#ifndef COMMAND_BUFFER_DISPATCH_H_INCLUDED
+#define COMMAND_BUFFER_DISPATCH_H_INCLUDED
+
+#include "command_buffer.h"
+#include "stubs.h"
+"""
+
+CPP_FOOTER = """
+#endif // COMMAND_BUFFER_DISPATCH_H_INCLUDED
+"""
+
+
+def param_type(param):
+    dtype = param.attrib['type']
+    if dtype == 'table':
+        return f"table:{param.attrib.get('item-type', 'any')}"
+    return dtype
+
+
+def parse_params(node, name):
+    params = node.find(name) if node is not None else None
+    if params is None:
+        return []
+    return [(p.attrib['name'], param_type(p)) for p in params.findall('param')]
+
+
+def parse(path):
+    root = ET.parse(path).getroot()
+    structs = [(s.attrib['name'], parse_params(s, '.')) for s in root.findall('struct')]
+    commands = []
+    for c in root.findall('command'):
+        if c.attrib['name'] in EXCLUDED:
+            continue
+        commands.append((c.attrib['name'], parse_params(c, 'params'), parse_params(c, 'return')))
+    return structs, commands
+
+
+def generate_cpp(structs, commands):
+    lines = [CPP_HEADER]
+    for name, fields in structs:
+        lines.append(f"inline void read_value(CommandReader & reader, {name} & value) {{")
+        lines.extend(f"  read_value(reader, value.{f});" for f, _ in fields)
+        lines.append("}\n")
+        lines.append(f"inline void write_value(CommandWriter & writer, const {name} & value) {{")
+        lines.extend(f"  write_value(writer, value.{f});" for f, _ in fields)
+        lines.append("}\n")
+    lines.append("// Returns false if the opcode is unknown")
+    lines.append("template <typename P>")
+    lines.append("bool dispatch_command(P & plugin, const SScriptCallBack & script, unsigned opcode,")
+    lines.append("                      unsigned number_of_arguments, CommandReader & reader,")
+    lines.append("                      CommandWriter & writer) {")
+    lines.append("  switch (opcode) {")
+    for opcode, (name, params, results) in enumerate(commands):
+        lines.append(f"    case {opcode}: {{")
+        lines.append(f"      {name}_in in;")
+        lines.append(f"      {name}_out out;")
+        lines.append("      in._ = script;")
+        # missing arguments keep their default value
+        for i, (p, _) in enumerate(params):
+            lines.append(f"      if (number_of_arguments > {i}) read_value(reader, in.{p});")
+        lines.append(f"      plugin.{name}(&in, &out);")
+        lines.append("      writer.begin_result();")
+        lines.extend(f"      write_value(writer, out.{r});" for r, _ in results)
+        lines.append("      return true;")
+        lines.append("    }")
+    lines.append("    default:")
+    lines.append("      return false;")
+    lines.append("  }")
+    lines.append("}")
+    lines.append(CPP_FOOTER)
+    return '\n'.join(lines)
+
+
+def lua_params(params):
+    return '{' + ', '.join(f"{{'{n}', '{t}'}}" for n, t in params) + '}'
+
+
+def generate_lua(structs, commands):
+    lines = ["-- Generated by helpers/generate_command_buffer.py: do not edit",
+             "return {", "    structs = {"]
+    for name, fields in structs:
+        lines.append(f"        {name} = {lua_params(fields)},")
+    lines.append("    },")
+    lines.append("    commands = {")
+    for opcode, (name, params, results) in enumerate(commands):
+        lines.append(f"        {name} = {{opcode = {opcode}, params = {lua_params(params)}, "
+                     f"results = {lua_params(results)}}},")
+    lines.append("    },")
+    lines.append("}")
+    return '\n'.join(lines) + '\n'
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Generate the command buffer interface')
+    parser.add_argument('file', type=str, help='the xml file that describes the commands')
+    parser.add_argument('--directory', type=str, default=".",
+                        help='the directory where to write the generated files')
+    args = parser.parse_args()
+    structs, commands = parse(args.file)
+    with open(os.path.join(args.directory, 'command_buffer_dispatch.h'), 'wt') as f:
+        f.write(generate_cpp(structs, commands))
+    with open(os.path.join(args.directory, 'simAsebaCommands-spec.lua'), 'wt') as f:
+        f.write(generate_lua(structs, commands))
@@ -0,0 +1,51 @@
+#ifndef ASEBA_ASYNC_SCRIPT_H_INCLUDED
+#define ASEBA_ASYNC_SCRIPT_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "aseba_node.h"
+
+// Compile Aseba scripts on a background thread.
+//
+// Requests are queued from the simulation thread and return a ticket immediately.
+// Parsing and compilation happen on a single worker thread (so that requests
+// for the same node are completed in order), while bytecode is always installed
+// from the simulation thread, by calling `install_compiled_scripts`
+// at the start of a step.
+
+namespace Aseba {
+
+// Keep in sync with the `script_status` enum in lua/callbacks.xml
+enum ScriptStatus {
+  SCRIPT_PENDING = 0,
+  SCRIPT_COMPILED = 1,
+  SCRIPT_LOADED = 2,
+  SCRIPT_FAILED = 3,
+  SCRIPT_UNKNOWN = 4
+};
+
+struct ScriptResult {
+  int ticket;
+  int node_handle;
+  bool success;
+  std::string message;
+  // Lua function to notify, if not empty
+  int script_id;
+  std::string callback;
+};
+
+// Returns the ticket of the request
+int compile_script_async(DynamicAsebaNode *node, int node_handle, const std::string &source,
+                         bool from_file, int script_id = -1, const std::string &callback = "");
+// Installs all scripts compiled since the last call and returns their results
+std::vector<ScriptResult> install_compiled_scripts();
+ScriptStatus script_status(int ticket, std::string &message);
+// Drops queued requests and forgets all tickets
+void cancel_scripts();
+// Cancels and joins the worker thread
+void stop_script_compiler();
+
+}
+
+#endif // ASEBA_ASYNC_SCRIPT_H_INCLUDED
@@ -0,0 +1,89 @@
+#ifndef ASEBA_DESCRIPTION_H_INCLUDED
+#define ASEBA_DESCRIPTION_H_INCLUDED
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "vm/vm.h"
+#include "vm/natives.h"
+
+// Returns a copy of `value` that lives until the end of the process.
+// Equal strings share the same copy.
+const char *intern_string(const std::string &value);
+
+// Stable integer handles to names, valid for all nodes: resolved once, then used
+// to access variables and events without looking up their names (see `DynamicAsebaNode`).
+// Handles are assigned from 0, in order, and never released.
+class NameHandles {
+ public:
+  unsigned resolve(const std::string &name);
+  const std::string &name(unsigned handle) const { return names[handle]; }
+  size_t size() const { return names.size(); }
+
+ private:
+  std::vector<std::string> names;
+  std::map<std::string, unsigned> handles;
+};
+
+NameHandles &variable_handles();
+NameHandles &event_handles();
+
+// The description of a node (variables, local events and native functions), laid out
+// as the C tables expected by the Aseba VM, together with the name lookups derived from them.
+//
+// Tables built from the same native description are shared, immutable, by all nodes
+// (see `shared`). A node makes its own copy only before extending its description.
+class AsebaDescriptionTables {
+ public:
+  static std::shared_ptr<const AsebaDescriptionTables> shared(
+      const std::string &name, const AsebaVMDescription *variables,
+      const AsebaLocalEventDescription *events,
+      const AsebaNativeFunctionDescription *const *functions, unsigned variables_capacity);
+
+  // name -> (offset in the node variables, size)
+  std::map<std::string, std::pair<unsigned, unsigned>> named_variable;
+  // name -> id
+  std::map<std::string, unsigned> named_event;
+  size_t number_of_functions() const { return function_pointers.size() - 1; }
+  unsigned used_variables() const { return next_variable; }
+
+  const AsebaVMDescription *variables() const {
+    return reinterpret_cast<const AsebaVMDescription *>(variables_storage.data());
+  }
+  const AsebaLocalEventDescription *events() const { return event_entries.data(); }
+  const AsebaNativeFunctionDescription *const *functions() const {
+    return function_pointers.data();
+  }
+
+  bool add_variable(const std::string &name, unsigned size);
+  bool add_event(const std::string &name, const std::string &description);
+  bool add_function(const std::string &name, const std::string &description,
+                    const std::vector<std::tuple<int, std::string>> &arguments);
+
+  AsebaDescriptionTables(const char *name, unsigned variables_capacity);
+
+ private:
+  unsigned capacity;
+  unsigned next_variable;
+  size_t number_of_variables;
+  // AsebaVMDescription ends with a flexible array: keep it in a growable, aligned buffer
+  std::vector<std::max_align_t> variables_storage;
+  // both arrays are kept null terminated
+  std::vector<AsebaLocalEventDescription> event_entries;
+  std::vector<const AsebaNativeFunctionDescription *> function_pointers;
+  // functions added at runtime (native ones point to static tables)
+  std::vector<std::shared_ptr<const AsebaNativeFunctionDescription>> owned_functions;
+
+  AsebaVMDescription *mutable_variables() {
+    return reinterpret_cast<AsebaVMDescription *>(variables_storage.data());
+  }
+  void reserve_variables(size_t number);
+  bool append_variable(const char *name, unsigned size);
+  bool append_event(const char *name, const char *description);
+};
+
+#endif // ASEBA_DESCRIPTION_H_INCLUDED
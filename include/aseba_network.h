@@ -12,6 +12,12 @@ namespace Aseba {
 void set_address(const std::string &);
 void configure_advertisement(bool enabled, bool external);
 void spin(float dt);
+// Whether to read and write the streams of all networks in a background thread,
+// which exchanges messages with the simulation thread through queues of `capacity` messages
+void configure_io_thread(bool enabled, unsigned capacity);
+// How to queue messages for slow clients (see `OutboundQueue::Policy`).
+// Returns false if the policy is not valid.
+bool configure_outbound_queue(int policy, unsigned capacity);
 void add_node(DynamicAsebaNode * node, unsigned port, unsigned uid);
 void destroy_node(unsigned uid);
 void destroy_all_nodes();
@@ -20,6 +26,16 @@ void remove_all_networks();
 void remove_network_with_port(int port);
 std::map<unsigned, std::vector<DynamicAsebaNode *>> node_list(unsigned port);
 DynamicAsebaNode * node_for_vm(AsebaVMState * vm);
+// port -> counters
+std::map<int, AsebaNetworkStats> network_stats();
+// uid -> node
+std::map<int, const DynamicAsebaNode *> all_nodes();
+// The counters of all nodes and networks in Prometheus text format
+std::string format_stats();
+// Serves `format_stats` over HTTP to local clients on `port` (disabled if 0)
+bool serve_stats(int port);
+// Answers pending requests for the stats, also while the simulation is not running
+void spin_stats();
 
 template<typename T>
 T * create_node(unsigned uid, unsigned port = 33333,
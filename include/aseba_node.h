@@ -3,6 +3,7 @@
 
 #include <array>
 #include <map>
+#include <memory>
 #include <vector>
 #include <tuple>
 #include <valarray>
@@ -17,8 +18,13 @@
 #include "common/utils/utils.h"
 #include "common/utils/FormatableString.h"
 #include "transport/buffer/vm-buffer.h"
+#include "aseba_description.h"
+#include "aseba_node_memory.h"
+#include "aseba_stats.h"
 #include "aseba_script.h"
 #include "logging.h"
+#include "profiler.h"
+#include "tracer.h"
 
 #define VARIABLES_TOTAL_SIZE 1024
 #define ID 0
@@ -26,8 +32,6 @@
 #define BYTECODE_SIZE 1534
 #define STACK_SIZE 32
 
-char *dydata(std::string value);
-
 extern "C" const AsebaNativeFunctionDescription* default_functions_description[];
 extern "C" const AsebaLocalEventDescription default_events_description[];
 extern "C" const AsebaVMDescription default_variables_description;
@@ -36,8 +40,17 @@ extern "C" const AsebaNativeFunctionPointer default_functions[];
 class DynamicAsebaNode
 {
 
-  std::valarray<unsigned short> bytecode;
-  std::valarray<signed short> stack;
+  // variables, stack and bytecode, from the node arena
+  AsebaVMLayout layout;
+  AsebaNodeSlab memory;
+  mutable std::shared_ptr<const Aseba::TargetDescription> target_description;
+  std::shared_ptr<const Aseba::TargetDescription> build_description() const;
+  std::shared_ptr<AsebaDescriptionTables> owned_descriptions;
+  // handle -> (offset, size) or (0, 0) if not defined, filled on demand
+  std::vector<std::pair<unsigned, unsigned>> variables_with_handle;
+  // handle -> event id or -1 if not defined, filled on demand
+  std::vector<int> events_with_handle;
+  static inline uint64_t created = 0;
 public:
   virtual const AsebaNativeFunctionDescription** native_functions_description () const {
     return default_functions_description;
@@ -53,164 +66,137 @@ public:
   }
 
 protected:
-  int16_t variables[VARIABLES_TOTAL_SIZE];
+  int16_t *variables;
   std::array<uint8_t, 16> uuid;
   std::string friendly_name;
   std::set<void *>sent_device_info;
 
 public:
   bool finalized;
+  // unique among all the nodes created, unlike addresses that are reused
+  const uint64_t serial;
   std::string name;
   AsebaVMState vm;
-  AsebaNativeFunctionDescription** functions_description;
-  AsebaLocalEventDescription *events_description;
-  AsebaVMDescription *variables_description;
+  // shared with the other nodes of the same type until the description is extended
+  std::shared_ptr<const AsebaDescriptionTables> descriptions;
 
   uint16_t lastMessageSource;
   std::valarray<uint8_t> lastMessageData;
+  AsebaNodeStats stats;
 
   Aseba::UnifiedTime lastTime;
-  // name -> (pointer, size)
-  std::map<std::string, std::pair<int16_t *, unsigned int>> named_variable;
-  int16_t *next_variable;
-  // name -> id
-  std::map<std::string, unsigned int> named_event;
   // [<name, argument sizes>]
   std::vector<std::pair<std::string, std::vector<int>>> lua_functions;
   size_t number_of_native_function;
 
   void init_descriptions()
   {
-    // init variable description
-    variables_description = (AsebaVMDescription *) malloc(sizeof(AsebaVMDescription) + 1 * sizeof(AsebaVariableDescription));
-    // variables_description->name = dydata(name);
-    variables_description->name = name.c_str();
-    variables_description->variables[0] = AsebaVariableDescription{0, NULL};
-    const AsebaVariableDescription *desc = native_variables_description()->variables;
-    for (; desc->size; desc++)
-    {
-      add_variable(std::string(desc->name), desc->size);
-    }
-    log_debug("Added %lu variables", named_variable.size());
-    // init event description
-    events_description = (AsebaLocalEventDescription *) malloc(sizeof(AsebaLocalEventDescription));
-    events_description[0] = AsebaLocalEventDescription{NULL, NULL};
-    const AsebaLocalEventDescription *event_desc = native_events_description();
-    for (; event_desc->name; event_desc++)
-    {
-      add_event(std::string(event_desc->name), std::string(event_desc->doc));
-    }
-    log_debug("Added %lu events", named_event.size());
-    // init function description
-    const AsebaNativeFunctionDescription **fun_desc = native_functions_description();
-    number_of_native_function = 0;
-    for (; *fun_desc; fun_desc++, number_of_native_function++);
-    fun_desc = native_functions_description();
-    functions_description = (AsebaNativeFunctionDescription **) calloc(number_of_native_function + 1, sizeof(AsebaNativeFunctionDescription));
-    std::copy((AsebaNativeFunctionDescription **)fun_desc, (AsebaNativeFunctionDescription **)(fun_desc + number_of_native_function + 1), functions_description);
-    log_debug("Added %lu functions", number_of_native_function);
+    descriptions = AsebaDescriptionTables::shared(
+        name, native_variables_description(), native_events_description(),
+        native_functions_description(), layout.variables_size);
+    invalidate_description();
+    number_of_native_function = descriptions->number_of_functions();
+    log_debug("Using %lu variables, %lu events and %lu functions",
+              descriptions->named_variable.size(), descriptions->named_event.size(),
+              number_of_native_function);
   }
 
  protected:
 
-  void free_descriptions()
-  {
-    // TODO (J): check and see if I cannot avoid some of these dynamic allocations, especially for strings.
-    // e.g. I could use a a pointer to a key stored in my variables (like `named_variable` or `node.name` ...)
-    size_t number = named_variable.size();
-    for (size_t i = 0; i < number; i++) {
-      free((void *)variables_description->variables[i].name);
-    }
-    // free((void *) variables_description->name);
-    free(variables_description);
-    number = named_event.size();
-    for (size_t i = 0; i < number; i++) {
-      free((void *)events_description[i].name);
-      free((void *)events_description[i].doc);
-    }
-    free(events_description);
-
-    number = lua_functions.size();
-    for (size_t i = 0; i < number; i++) {
-      AsebaNativeFunctionDescription *function = functions_description[number_of_native_function + i];
-      free((void *)function->name);
-      free((void *)function->doc);
-      AsebaNativeFunctionArgumentDescription* arg = function->arguments;
-      for (; arg->size; arg++) {
-        free((void* )arg->name);
-      }
-      free(function);
+  void invalidate_description() {
+    target_description.reset();
+    variables_with_handle.clear();
+    events_with_handle.clear();
+  }
+
+  // Copy on write: the shared tables are never modified
+  AsebaDescriptionTables & own_descriptions() {
+    if (!owned_descriptions) {
+      owned_descriptions = std::make_shared<AsebaDescriptionTables>(*descriptions);
+      descriptions = owned_descriptions;
     }
-    free(functions_description);
+    invalidate_description();
+    return *owned_descriptions;
   }
 
 public:
   DynamicAsebaNode(int node_id, const std::string & _name, const std::array<uint8_t, 16> & uuid_,
-                   const std::string & friendly_name_ = ""):
-    finalized(false), name(_name), friendly_name(friendly_name_), uuid(uuid_),
+                   const std::string & friendly_name_ = "",
+                   const AsebaVMLayout & layout_ = {BYTECODE_SIZE, STACK_SIZE, VARIABLES_TOTAL_SIZE}):
+    layout(layout_), memory(AsebaNodeArena::allocate(layout_)),
+    finalized(false), serial(++created), name(_name), friendly_name(friendly_name_), uuid(uuid_),
     sent_device_info() {
     // setup variables
     vm.nodeId = (int32_t) node_id;
-    bytecode.resize(BYTECODE_SIZE);
-    vm.bytecode = &bytecode[0];
-    vm.bytecodeSize = bytecode.size();
-    stack.resize(STACK_SIZE);
-    vm.stack = &stack[0];
-    vm.stackSize = stack.size();
-    vm.variables = reinterpret_cast<int16_t *>(&variables);
-    vm.variablesSize = sizeof(variables) / sizeof(int16_t);
+    vm.bytecode = memory.bytecode;
+    vm.bytecodeSize = layout.bytecode_size;
+    vm.stack = memory.stack;
+    vm.stackSize = layout.stack_size;
+    variables = memory.variables;
+    vm.variables = variables;
+    vm.variablesSize = layout.variables_size;
     AsebaVMInit(&vm);
     vm.flags = ASEBA_VM_STEP_BY_STEP_MASK;
     variables[ID] = vm.nodeId;
-    next_variable = variables;
     // init_descriptions();
     // printf("name %s %s\n", name.c_str(), variables_description->name);
   }
-  ~DynamicAsebaNode()
+  // the memory slab is owned by a single node
+  DynamicAsebaNode(const DynamicAsebaNode &) = delete;
+  DynamicAsebaNode & operator=(const DynamicAsebaNode &) = delete;
+
+  virtual ~DynamicAsebaNode()
   {
-    free_descriptions();
+    AsebaNodeArena::release(layout, memory);
     log_info("Deleted node %s", name.c_str());
   }
 
   virtual void step(float dt)
   {
-    AsebaVMRun(&vm, 1000);
+    run();
+  }
+
+  // Like AsebaVMRun(&vm, 1000). With ASEBA_COUNT_INSTRUCTIONS, the instructions are run
+  // one by one to count them, which is slower.
+  void run(int event = -1)
+  {
+    PROFILE_SCOPE(VM);
+    TRACE_SCOPE("AsebaVMRun", vm.nodeId, event);
+#ifdef ASEBA_COUNT_INSTRUCTIONS
+    unsigned steps = 0;
+    // NOTE(Jerome): AsebaVMRun returns 0 when no event is active or the VM is paused,
+    // and 1 without executing anything when it stops at a breakpoint, which pauses the VM
+    while (steps < 1000 && AsebaVMRun(&vm, 1)) {
+      if (AsebaMaskIsSet(vm.flags, ASEBA_VM_STEP_BY_STEP_MASK)) break;
+      steps++;
+    }
+    if (steps) {
+      stats.vm_runs++;
+      stats.vm_instructions += steps;
+    }
+#else
+    if (AsebaVMRun(&vm, 1000)) stats.vm_runs++;
+#endif
   }
 
   void add_variable(std::string name, unsigned int size)
   {
     log_debug("Try to add variable %s of size %d", name.c_str(), size);
-    if(named_variable.count(name))
+    if (descriptions->named_variable.count(name))
     {
       log_warn("Variable %s cannot be added: already defined", name.c_str());
       return;
     }
-    size_t number = named_variable.size();
-    if(next_variable + size > variables + VARIABLES_TOTAL_SIZE)
-    {
-      log_warn("Variable %s cannot be added: not enough free space", name.c_str());
-      return;
-    }
-    AsebaVMDescription * tmp = (AsebaVMDescription *) realloc(variables_description, sizeof(AsebaVMDescription) + (number + 2) * sizeof(AsebaVariableDescription));
-    if(!tmp)
-    {
-      log_warn("Failed to realloc variables_description!");
-      return;
-    }
-    variables_description = tmp;
-    named_variable[name] = std::make_pair(next_variable, size);
-    variables_description->variables[number] = AsebaVariableDescription{(uint16_t) size, dydata(name)};
-    variables_description->variables[number+1] = AsebaVariableDescription{0, NULL};
-    next_variable += size;
-    log_debug("Added variable");
+    if (own_descriptions().add_variable(name, size))
+      log_debug("Added variable");
   }
 
   std::vector<int> get_variable(std::string name)
   {
-    if(!named_variable.count(name)) return std::vector<int>();
-    auto pair = named_variable[name];
-    int16_t *address = pair.first;
-    size_t size= pair.second;
+    auto it = descriptions->named_variable.find(name);
+    if (it == descriptions->named_variable.end()) return std::vector<int>();
+    int16_t *address = variables + it->second.first;
+    size_t size = it->second.second;
     std::vector<int> value;
     value.assign(address, address + size);
     return value;
@@ -218,47 +204,73 @@ public:
 
   void set_variable(std::string name, std::vector<int> value)
   {
-    if(!named_variable.count(name)) return;
-    auto pair = named_variable[name];
-    int16_t *address = pair.first;
-    size_t size= std::min((unsigned int) value.size(), pair.second);
+    auto it = descriptions->named_variable.find(name);
+    if (it == descriptions->named_variable.end()) return;
+    int16_t *address = variables + it->second.first;
+    size_t size = std::min((unsigned int) value.size(), it->second.second);
     std::copy(value.begin(), value.begin() + size, address);
   }
 
+  // Returns the address and size of the variable resolved as `handle`
+  // (see `variable_handles`), or (nullptr, 0) if the node has no such variable
+  std::pair<int16_t *, unsigned> variable_with_handle(unsigned handle)
+  {
+    const NameHandles & handles = variable_handles();
+    if (handle >= handles.size()) return {nullptr, 0};
+    while (variables_with_handle.size() <= handle) {
+      auto it = descriptions->named_variable.find(handles.name(variables_with_handle.size()));
+      if (it == descriptions->named_variable.end())
+        variables_with_handle.emplace_back(0, 0);
+      else
+        variables_with_handle.push_back(it->second);
+    }
+    const auto & [offset, size] = variables_with_handle[handle];
+    if (!size) return {nullptr, 0};
+    return {variables + offset, size};
+  }
+
+  // Returns the id of the event resolved as `handle` (see `event_handles`), or -1
+  int event_with_handle(unsigned handle)
+  {
+    const NameHandles & handles = event_handles();
+    if (handle >= handles.size()) return -1;
+    while (events_with_handle.size() <= handle) {
+      auto it = descriptions->named_event.find(handles.name(events_with_handle.size()));
+      events_with_handle.push_back(it == descriptions->named_event.end() ? -1 : int(it->second));
+    }
+    return events_with_handle[handle];
+  }
+
   void add_event(std::string name, std::string description)
   {
-    if(named_event.count(name))
+    if (descriptions->named_event.count(name))
     {
       log_warn("Event %s cannot be added: already defined", name.c_str());
       return;
     }
-    size_t number = named_event.size();
-    events_description = (AsebaLocalEventDescription *) realloc(events_description, (number + 2) * sizeof(AsebaLocalEventDescription));
-    if(!events_description)
-    {
-      log_warn("Failed to realloc events_description!");
-      return;
-    }
-    named_event[name] = number;
-    events_description[number] = AsebaLocalEventDescription{dydata(name), dydata(description)};
-    events_description[number+1] = AsebaLocalEventDescription{NULL, NULL};
+    own_descriptions().add_event(name, description);
   }
 
   // ! Execute a local event, killing the execution of the current one if not in step-by-step mode
   void emit(std::string name) {
-    if(!named_event.count(name)) return;
-    unsigned int number = named_event[name];
-    emit(number);
+    auto it = descriptions->named_event.find(name);
+    if (it == descriptions->named_event.end()) return;
+    emit((uint16_t) it->second);
   }
 
   void emit(uint16_t number) {
   // in step-by-step, only setup an event if none is being executed currently
-  if (AsebaMaskIsSet(vm.flags, ASEBA_VM_STEP_BY_STEP_MASK) && AsebaMaskIsSet(vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+  if (AsebaMaskIsSet(vm.flags, ASEBA_VM_STEP_BY_STEP_MASK) && AsebaMaskIsSet(vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK)) {
+    stats.events_dropped++;
     return;
+  }
+  if (AsebaMaskIsSet(vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+    stats.events_interrupted++;
 
   variables[SOURCE] = vm.nodeId;
   AsebaVMSetupEvent(&vm, ASEBA_EVENT_LOCAL_EVENTS_START-number);
-  AsebaVMRun(&vm, 1000);
+  stats.events_emitted++;
+  run(number);
 }
 
   void add_function(const std::string & name, const std::string & description,
@@ -274,83 +286,53 @@ public:
         return;
       }
     }
-    size_t number = lua_functions.size() + number_of_native_function;
     std::vector<int> sizes;
-    functions_description = (AsebaNativeFunctionDescription **) realloc(functions_description, (number + 2) * sizeof(AsebaNativeFunctionDescription*));
-    if(!functions_description)
-    {
-      log_warn("Failed to realloc functions_description!");
-      return;
-    }
-    AsebaNativeFunctionDescription * desc = (AsebaNativeFunctionDescription *) malloc(sizeof(AsebaNativeFunctionDescription) + (1 + arguments.size()) * sizeof(AsebaNativeFunctionArgumentDescription));
-    if(!desc)
-    {
-        log_warn("Failed to malloc AsebaNativeFunctionDescription!");
-        return;
-    }
-    desc->name = dydata(name);
-    desc->doc = dydata(description);
-    AsebaNativeFunctionArgumentDescription* arg = desc->arguments;
-    for(auto &v : arguments)
+    for (auto &v : arguments)
     {
-      arg->name = dydata(std::get<1>(v));
-      arg->size = std::get<0>(v);
-      sizes.push_back(arg->size);
-      arg++;
+      sizes.push_back(std::get<0>(v));
     }
-    arg->name = NULL;
-    arg->size = 0;
-    functions_description[number] = desc;
-    functions_description[number+1] = NULL;
+    own_descriptions().add_function(name, description, arguments);
     lua_functions.push_back(make_pair(callback_name, sizes));
     log_debug("Added function");
   }
 
   void connect()
+  {
+    finalize();
+  }
+
+  void finalize()
   {
     finalized = true;
+    get_description();
   }
 
   void do_step(double dt) {};
 
-  const Aseba::TargetDescription get_description() const {
-    Aseba::TargetDescription d;
-    d.name = widen(name);
-    d.bytecodeSize = BYTECODE_SIZE;
-    d.variablesSize = VARIABLES_TOTAL_SIZE;
-    d.stackSize = STACK_SIZE;
-
-    for (AsebaVariableDescription * v = variables_description->variables; v->name != NULL; v++) {
-      d.namedVariables.push_back(Aseba::TargetDescription::NamedVariable(widen(v->name), v->size));
-    }
-    for (AsebaLocalEventDescription * e = events_description; e->name != NULL; e++) {
-      Aseba::TargetDescription::LocalEvent event{widen(e->name), std::wstring()};
-      d.localEvents.push_back(event);
+  // The description is built once, shared by all nodes with identical descriptions
+  // (see `build_description`) and rebuilt only after the description changes.
+  std::shared_ptr<const Aseba::TargetDescription> get_description() const {
+    if (!target_description) {
+      target_description = build_description();
     }
-    for (AsebaNativeFunctionDescription ** fd = functions_description; * fd != 0; fd++) {
-      Aseba::TargetDescription::NativeFunction f;
-      f.name = widen((*fd)->name);
-      for (AsebaNativeFunctionArgumentDescription * argument = (*fd)->arguments; argument->name != 0 ;
-           argument++) {
-        f.parameters.push_back(
-            Aseba::TargetDescription::NativeFunctionParameter(widen(argument->name), argument->size));
-      }
-      d.nativeFunctions.push_back(f);
-    }
-    return d;
+    return target_description;
   }
 
   bool load_script(const std::shared_ptr<AsebaScript> & script) {
     bool success = false;
     Aseba::VariablesMap user_variables;
     Aseba::BytecodeVector bytecode;
-    const Aseba::TargetDescription desc = get_description();
-    success = script->compile(vm.nodeId, &desc, user_variables, bytecode);
+    success = script->compile(vm.nodeId, get_description().get(), user_variables, bytecode);
     if (!success) {
       log_warn("Failed to compile script");
       return false;
     }
     log_info("Compiled script to %lu bytecodes", bytecode.size());
+    install_bytecode(bytecode);
+    return true;
+  }
+
+  void install_bytecode(const Aseba::BytecodeVector & bytecode) {
     // mgs = {destination, start_index, bytecodes...}
     std::vector<uint16_t> set_bytecode_data = {vm.nodeId, 0};
     std::copy(bytecode.begin(), bytecode.end(), std::back_inserter(set_bytecode_data));
@@ -364,9 +346,8 @@ public:
     // AsebaVMRun(&vm, 1000);
     uint16_t data[1] = {vm.nodeId};
     AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_RUN, data, 1);
-    AsebaVMRun(&vm, 1000);
+    run();
     log_info("Loaded script to node");
-    return true;
   }
 
   bool load_script_from_text(const std::string & text) {
@@ -0,0 +1,53 @@
+#ifndef ASEBA_NODE_MEMORY_H_INCLUDED
+#define ASEBA_NODE_MEMORY_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Sizes (in words) of the memory of an Aseba VM
+struct AsebaVMLayout {
+  unsigned bytecode_size;
+  unsigned stack_size;
+  unsigned variables_size;
+
+  bool operator<(const AsebaVMLayout &other) const {
+    return std::tie(bytecode_size, stack_size, variables_size) <
+           std::tie(other.bytecode_size, other.stack_size, other.variables_size);
+  }
+};
+
+// The memory of one node: variables, stack and bytecode, contiguous and
+// each aligned to a cache line.
+struct AsebaNodeSlab {
+  int16_t *variables;
+  int16_t *stack;
+  uint16_t *bytecode;
+};
+
+// Arena of node memory.
+//
+// Slabs with the same layout are carved from large, cache-line-aligned chunks,
+// so that the nodes of a simulation (that are stepped one after the other) sit next
+// to each other in memory. Released slabs are kept on a per-layout free list and
+// reused by the next node with the same layout, e.g., when the simulation is restarted.
+class AsebaNodeArena {
+ public:
+  static constexpr size_t alignment = 64;
+  // Returns zeroed memory
+  static AsebaNodeSlab allocate(const AsebaVMLayout &layout);
+  static void release(const AsebaVMLayout &layout, const AsebaNodeSlab &slab);
+
+ private:
+  struct Pool {
+    size_t slab_size = 0;
+    std::vector<char *> free_slabs;
+  };
+  inline static std::map<AsebaVMLayout, Pool> pools;
+  // NOTE(Jerome): chunks are never returned to the system, only recycled
+  inline static std::vector<char *> chunks;
+};
+
+#endif // ASEBA_NODE_MEMORY_H_INCLUDED
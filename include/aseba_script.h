@@ -41,9 +41,11 @@ public:
   static std::shared_ptr<AsebaScript> from_code_string(
       const std::string &value, std::string & name, unsigned id);
 
+  // On failure, a description of the error is written to `error_message` if not null
   bool compile(unsigned node_id, const Aseba::TargetDescription *description,
                Aseba::VariablesMap &variable_map,
-               Aseba::BytecodeVector &bytecode);
+               Aseba::BytecodeVector &bytecode,
+               std::string *error_message = nullptr);
   AsebaScript() : common_definitions(), code(){};
   // user events and constants
   Aseba::CommonDefinitions common_definitions;
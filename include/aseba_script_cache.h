@@ -0,0 +1,58 @@
+#ifndef ASEBA_SCRIPT_CACHE_H_INCLUDED
+#define ASEBA_SCRIPT_CACHE_H_INCLUDED
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#if defined(_WIN32)
+#undef ERROR_STACK_OVERFLOW
+#endif
+
+#include "compiler/compiler.h"
+
+// Process-wide cache of compiled Aseba scripts.
+//
+// Entries are addressed by a hash of everything the compiler reads: the aesl code,
+// the common definitions (user events and constants) and the target description.
+// Nodes of the same type loading the same code therefore share a single compilation.
+// When a directory is configured, entries are also persisted to disk and reused
+// in later sessions.
+// The cache is shared by the simulation thread and the asynchronous compiler worker,
+// so all accesses are serialized.
+
+class AsebaScriptCache {
+ public:
+  typedef uint64_t Key;
+
+  struct Entry {
+    Aseba::BytecodeVector bytecode;
+    Aseba::VariablesMap variables;
+  };
+
+  static Key key(const Aseba::TargetDescription *description,
+                 const Aseba::CommonDefinitions *common_definitions,
+                 const std::string &code);
+  // Returns nullptr on misses
+  static std::shared_ptr<const Entry> get(Key key);
+  static void put(Key key, const std::shared_ptr<const Entry> &entry);
+  // An empty path disables persistence
+  static void configure(bool enabled, const std::string &path = "");
+  static void clear();
+  static bool is_enabled() { return enabled; }
+
+ private:
+  inline static bool enabled = true;
+  inline static std::filesystem::path directory;
+  inline static std::map<Key, std::shared_ptr<const Entry>> entries;
+  inline static std::mutex mutex;
+
+  static std::filesystem::path path_for_key(Key key);
+  static std::shared_ptr<const Entry> load(Key key);
+  static void save(Key key, const Entry &entry);
+};
+
+#endif // ASEBA_SCRIPT_CACHE_H_INCLUDED
@@ -0,0 +1,247 @@
+#ifndef ASEBA_SHM_H_INCLUDED
+#define ASEBA_SHM_H_INCLUDED
+
+/*
+ * Layout of the shared memory where the plugin publishes the state of all robots
+ * at each simulation step (see `configure_shared_memory`), and a small library
+ * to read it from other processes.
+ *
+ * The region starts with an `aseba_shm_header_t`, followed by two buffers.
+ * Each buffer holds one frame: an `aseba_shm_frame_t` followed by `max_robots`
+ * records of `robot_stride` bytes. A record is an `aseba_shm_robot_t` followed by
+ * `variables_size` int16 words with the selected Aseba variables (see `variables`).
+ *
+ * The plugin writes frame n in buffer n % 2: it first sets `writing` to n, then fills
+ * the buffer, then sets `sequence` to n. Readers never block the plugin: they read the
+ * frame `sequence` and then check that `writing` did not reach `sequence + 2`,
+ * i.e., that the buffer has not been overwritten meanwhile
+ * (see `aseba_shm_begin_read` and `aseba_shm_end_read`).
+ *
+ * In the other direction, one external controller can push commands to a ring in a second
+ * region (see `configure_command_ring`): an `aseba_shm_ring_header_t` followed by `capacity`
+ * commands. The controller is the only one to write `head` and the plugin the only one
+ * to write `tail`, so that neither needs locks. At the beginning of each step, the plugin
+ * executes the commands queued for that step (or for previous steps), in order.
+ *
+ * The images of e-puck cameras can be shared too (see `_epuck_configure_camera_export`),
+ * in a third region: an `aseba_shm_cameras_header_t` followed by `max_cameras` cameras.
+ * Each camera is an `aseba_shm_camera_t` followed by a ring of `depth` images, written
+ * as frames are captured. Frame n is in slot (n - 1) % depth and remains valid until
+ * `writing` reaches n + depth.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ASEBA_SHM_MAGIC 0x4d485341u /* "ASHM" */
+#define ASEBA_SHM_VERSION 1
+#define ASEBA_SHM_MAX_VARIABLES 32
+#define ASEBA_SHM_NAME_SIZE 32
+
+enum { ASEBA_SHM_NONE = 0, ASEBA_SHM_THYMIO2 = 1, ASEBA_SHM_EPUCK = 2 };
+
+typedef struct {
+  char name[ASEBA_SHM_NAME_SIZE];
+  /* in words, from the start of the variables of a robot */
+  uint32_t offset;
+  uint32_t size;
+} aseba_shm_variable_t;
+
+typedef struct {
+  int32_t id;
+  /* one of ASEBA_SHM_THYMIO2 and ASEBA_SHM_EPUCK */
+  uint32_t type;
+  /* in the world frame [m] */
+  float position[3];
+  /* Euler angles as in CoppeliaSim [rad] */
+  float orientation[3];
+  /* [m/s] */
+  float wheel_speed[2];
+  /* unused sensors are set to zero (e.g., Thymio has 7 proximity sensors) */
+  float proximity[8];
+  float ground[3];
+  /* [m/s^2] */
+  float acceleration[3];
+  /* Thymio: top LED, e-puck: body LED */
+  float led_rgb[3];
+  /* Thymio: bit i is set if LED i is on, e-puck: ring LEDs in bits 0 to 7,
+     body LED in bit 8, front LED in bit 9 */
+  uint32_t leds;
+} aseba_shm_robot_t;
+
+typedef struct {
+  /* the simulation step, counted from 1 since the simulation started */
+  uint64_t step;
+  /* simulation time [s] */
+  double time;
+  uint32_t number_of_robots;
+  uint32_t reserved;
+} aseba_shm_frame_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t max_robots;
+  uint32_t number_of_variables;
+  /* in words */
+  uint32_t variables_size;
+  /* in bytes */
+  uint32_t robot_stride;
+  uint64_t buffer_size;
+  uint64_t buffer_offset[2];
+  /* the last complete frame (0 if none) */
+  uint64_t sequence;
+  /* the frame being written */
+  uint64_t writing;
+  aseba_shm_variable_t variables[ASEBA_SHM_MAX_VARIABLES];
+} aseba_shm_header_t;
+
+static inline const aseba_shm_robot_t *aseba_shm_robot(const aseba_shm_header_t *header,
+                                                       const aseba_shm_frame_t *frame,
+                                                       uint32_t index) {
+  return (const aseba_shm_robot_t *)((const char *)(frame + 1) +
+                                     (uint64_t)index * header->robot_stride);
+}
+
+static inline const int16_t *aseba_shm_robot_variables(const aseba_shm_robot_t *robot) {
+  return (const int16_t *)(robot + 1);
+}
+
+/* Commands */
+
+#define ASEBA_SHM_RING_MAGIC 0x52485341u /* "ASHR" */
+#define ASEBA_SHM_COMMAND_WORDS 16
+
+enum {
+  /* values[0], values[1]: left and right target speeds [m/s] */
+  ASEBA_SHM_SET_TARGET_SPEED = 1,
+  /* Thymio: values[0:3] RGB of LED `index`,
+     e-puck: LED `index` (numbered as in `leds`) on if values[0] > 0 */
+  ASEBA_SHM_SET_LED = 2,
+  /* Thymio: button `index` pressed if values[0] > 0 */
+  ASEBA_SHM_SET_BUTTON = 3,
+  /* the first `index` words of Aseba variable `variable` */
+  ASEBA_SHM_SET_VARIABLE = 4
+};
+
+typedef struct {
+  /* the simulation step at which to execute the command (see `aseba_shm_frame_t`),
+     before updating the robots; commands for past steps are executed as soon as possible */
+  uint64_t step;
+  int32_t id;
+  uint16_t type;
+  uint16_t index;
+  float values[4];
+  char variable[ASEBA_SHM_NAME_SIZE];
+  int16_t words[ASEBA_SHM_COMMAND_WORDS];
+} aseba_shm_command_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /* a power of two */
+  uint32_t capacity;
+  uint32_t reserved;
+  char padding_0[48];
+  /* the number of commands pushed so far */
+  uint64_t head;
+  char padding_1[56];
+  /* the number of commands executed so far */
+  uint64_t tail;
+  char padding_2[56];
+} aseba_shm_ring_header_t;
+
+static inline aseba_shm_command_t *aseba_shm_ring_commands(aseba_shm_ring_header_t *header) {
+  return (aseba_shm_command_t *)(header + 1);
+}
+
+/* Cameras */
+
+#define ASEBA_SHM_CAMERAS_MAGIC 0x43485341u /* "ASHC" */
+
+typedef struct {
+  /* counted from 1 */
+  uint64_t frame;
+  /* simulation time of the capture [s] */
+  double time;
+} aseba_shm_image_t; /* followed by `height` rows of `width` RGB pixels (8 bits per channel) */
+
+typedef struct {
+  /* the id of the robot (-1 if the camera is not used) */
+  int32_t id;
+  uint32_t reserved;
+  /* the last complete frame (0 if none) */
+  uint64_t frames;
+  /* the frame being written */
+  uint64_t writing;
+  char padding[40];
+} aseba_shm_camera_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t max_cameras;
+  uint32_t depth;
+  uint32_t width;
+  uint32_t height;
+  /* in bytes */
+  uint64_t image_stride;
+  uint64_t camera_stride;
+} aseba_shm_cameras_header_t;
+
+static inline const uint8_t *aseba_shm_image_pixels(const aseba_shm_image_t *image) {
+  return (const uint8_t *)(image + 1);
+}
+
+/* Reader */
+
+typedef struct aseba_shm_reader aseba_shm_reader_t;
+
+/* Returns NULL if the region does not exist or is not compatible */
+aseba_shm_reader_t *aseba_shm_open(const char *name);
+void aseba_shm_close(aseba_shm_reader_t *reader);
+const aseba_shm_header_t *aseba_shm_header(const aseba_shm_reader_t *reader);
+/* Returns the latest frame (NULL if none) and sets its sequence number.
+   The frame is read in place: no copies. */
+const aseba_shm_frame_t *aseba_shm_begin_read(const aseba_shm_reader_t *reader,
+                                              uint64_t *sequence);
+/* Returns 1 if the frame has not been overwritten since `aseba_shm_begin_read`,
+   else the values read are not consistent and should be discarded. */
+int aseba_shm_end_read(const aseba_shm_reader_t *reader, uint64_t sequence);
+
+/* Camera reader */
+
+typedef struct aseba_shm_cameras aseba_shm_cameras_t;
+
+/* Returns NULL if the region does not exist or is not compatible */
+aseba_shm_cameras_t *aseba_shm_open_cameras(const char *name);
+void aseba_shm_close_cameras(aseba_shm_cameras_t *cameras);
+const aseba_shm_cameras_header_t *aseba_shm_cameras_header(const aseba_shm_cameras_t *cameras);
+const aseba_shm_camera_t *aseba_shm_camera(const aseba_shm_cameras_t *cameras, uint32_t index);
+/* Returns the latest image of a camera (NULL if none) and sets its frame number.
+   The image is read in place: no copies. */
+const aseba_shm_image_t *aseba_shm_begin_read_image(const aseba_shm_cameras_t *cameras,
+                                                    uint32_t index, uint64_t *frame);
+/* Returns 1 if the image has not been overwritten since `aseba_shm_begin_read_image` */
+int aseba_shm_end_read_image(const aseba_shm_cameras_t *cameras, uint32_t index,
+                             uint64_t frame);
+
+/* Controller */
+
+typedef struct aseba_shm_controller aseba_shm_controller_t;
+
+/* Returns NULL if the ring does not exist or is not compatible */
+aseba_shm_controller_t *aseba_shm_open_controller(const char *name);
+void aseba_shm_close_controller(aseba_shm_controller_t *controller);
+/* Returns 1 if the command has been queued, 0 if the ring is full */
+int aseba_shm_push_command(aseba_shm_controller_t *controller,
+                           const aseba_shm_command_t *command);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASEBA_SHM_H_INCLUDED */
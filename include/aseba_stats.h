@@ -0,0 +1,52 @@
+#ifndef ASEBA_STATS_H_INCLUDED
+#define ASEBA_STATS_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+// Counters of the activity of an Aseba node, since its creation
+struct AsebaNodeStats {
+  // runs of an active event
+  uint64_t vm_runs = 0;
+  // only counted with ASEBA_COUNT_INSTRUCTIONS
+  uint64_t vm_instructions = 0;
+  // local events emitted by the plugin (e.g., timers, buttons, `emit_event`)
+  uint64_t events_emitted = 0;
+  // emitted while another event was still running, which has been killed
+  uint64_t events_interrupted = 0;
+  // not emitted because the node was paused in the middle of another event
+  uint64_t events_dropped = 0;
+  // by native function id (natives of the node, followed by those added from Lua)
+  std::vector<uint64_t> native_calls;
+  uint64_t lua_calls = 0;
+  // spent in Lua functions called immediately (see `configure_functions`) [s]
+  double lua_time = 0.0;
+
+  void count_native_call(unsigned id) {
+    if (id >= native_calls.size()) native_calls.resize(id + 1);
+    native_calls[id]++;
+  }
+};
+
+// Counters of the messages exchanged by a network (i.e., the nodes listening on a port)
+struct AsebaNetworkStats {
+  uint64_t messages_in = 0;
+  uint64_t bytes_in = 0;
+  uint64_t messages_out = 0;
+  uint64_t bytes_out = 0;
+  // not sent because the queue of the I/O thread or of the client was full
+  uint64_t messages_dropped = 0;
+  // replaced by a newer value while queued for the client
+  uint64_t messages_coalesced = 0;
+  // messages queued for the client
+  uint64_t queue_depth = 0;
+  uint64_t max_queue_depth = 0;
+  uint64_t connections = 0;
+  // disconnected by the I/O thread, as they sent more messages than could be queued
+  uint64_t clients_dropped = 0;
+  // user events and variable polls dropped by the I/O thread while waiting for the simulation
+  uint64_t requests_dropped = 0;
+  unsigned clients = 0;
+};
+
+#endif // ASEBA_STATS_H_INCLUDED
@@ -0,0 +1,38 @@
+#ifndef CAMERA_EXPORT_H_INCLUDED
+#define CAMERA_EXPORT_H_INCLUDED
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "aseba_shm.h"
+#include "shared_memory.h"
+
+// A pool of frame rings in shared memory, one per exported camera
+// (see aseba_shm.h for the layout). Cameras write their frames in place.
+class CameraExport {
+ public:
+  bool open(const std::string & name, unsigned max_cameras, unsigned depth,
+            unsigned width, unsigned height);
+  void close();
+  bool is_open() const { return bool(memory); }
+  // Returns the index of the ring assigned to the camera of robot `id`,
+  // or -1 if all are in use
+  int attach(int id);
+  void detach(int index);
+  // Returns where to write the pixels of the next frame
+  uint8_t * begin_frame(int index);
+  void end_frame(int index, double time);
+  // The pixels of the last complete frame, nullptr if none
+  const uint8_t * last_frame(int index) const;
+  size_t frame_size() const;
+
+ private:
+  std::unique_ptr<SharedMemory> memory;
+  aseba_shm_cameras_header_t * header = nullptr;
+
+  aseba_shm_camera_t * camera(int index) const;
+  aseba_shm_image_t * image(aseba_shm_camera_t * camera, uint64_t frame) const;
+};
+
+#endif // CAMERA_EXPORT_H_INCLUDED
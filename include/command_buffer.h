@@ -0,0 +1,118 @@
+#ifndef COMMAND_BUFFER_H_INCLUDED
+#define COMMAND_BUFFER_H_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary encoding of the commands executed by `execute_commands`, in native byte order:
+//
+// - command: opcode (uint16), number of arguments (uint8), arguments
+// - result: status (uint8, 0 if successful), return values or, on failure, the error message
+//
+// Values are encoded as:
+// - int: int32, float: float32, double: float64, bool: uint8
+// - string and buffer: length (uint32), bytes
+// - table: number of items (uint32), items
+// - struct: fields, in order
+//
+// The opcodes and the types of arguments and return values are generated from lua/callbacks.xml
+// by helpers/generate_command_buffer.py.
+
+class CommandReader {
+ public:
+  explicit CommandReader(const std::string & buffer_)
+      : buffer(buffer_), position(0) {}
+
+  bool at_end() const { return position >= buffer.size(); }
+
+  template <typename T>
+  T read() {
+    static_assert(std::is_arithmetic<T>::value);
+    T value;
+    std::memcpy(&value, consume(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  std::string read_string() {
+    const uint32_t size = read<uint32_t>();
+    return std::string(consume(size), size);
+  }
+
+ private:
+  const std::string & buffer;
+  size_t position;
+
+  const char * consume(size_t size) {
+    if (size > buffer.size() - position) {
+      throw std::runtime_error("Command buffer is truncated");
+    }
+    const char * data = buffer.data() + position;
+    position += size;
+    return data;
+  }
+};
+
+class CommandWriter {
+ public:
+  explicit CommandWriter(std::string & buffer_) : buffer(buffer_) {}
+
+  template <typename T>
+  void write(T value) {
+    static_assert(std::is_arithmetic<T>::value);
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void write_string(const std::string & value) {
+    write<uint32_t>(value.size());
+    buffer.append(value);
+  }
+
+  void begin_result() { write<uint8_t>(0); }
+
+  void write_error(const std::string & message) {
+    write<uint8_t>(1);
+    write_string(message);
+  }
+
+ private:
+  std::string & buffer;
+};
+
+inline void read_value(CommandReader & reader, int & value) { value = reader.read<int32_t>(); }
+inline void read_value(CommandReader & reader, float & value) { value = reader.read<float>(); }
+inline void read_value(CommandReader & reader, double & value) { value = reader.read<double>(); }
+inline void read_value(CommandReader & reader, bool & value) { value = reader.read<uint8_t>(); }
+inline void read_value(CommandReader & reader, std::string & value) {
+  value = reader.read_string();
+}
+
+template <typename T>
+void read_value(CommandReader & reader, std::vector<T> & value) {
+  const uint32_t size = reader.read<uint32_t>();
+  value.resize(size);
+  for (auto & item : value) {
+    read_value(reader, item);
+  }
+}
+
+inline void write_value(CommandWriter & writer, int value) { writer.write<int32_t>(value); }
+inline void write_value(CommandWriter & writer, float value) { writer.write<float>(value); }
+inline void write_value(CommandWriter & writer, double value) { writer.write<double>(value); }
+inline void write_value(CommandWriter & writer, bool value) { writer.write<uint8_t>(value); }
+inline void write_value(CommandWriter & writer, const std::string & value) {
+  writer.write_string(value);
+}
+
+template <typename T>
+void write_value(CommandWriter & writer, const std::vector<T> & value) {
+  writer.write<uint32_t>(value.size());
+  for (const auto & item : value) {
+    write_value(writer, item);
+  }
+}
+
+#endif // COMMAND_BUFFER_H_INCLUDED
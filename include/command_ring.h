@@ -0,0 +1,49 @@
+#ifndef COMMAND_RING_H_INCLUDED
+#define COMMAND_RING_H_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "aseba_shm.h"
+#include "shared_memory.h"
+
+// The plugin side of the ring of commands pushed by an external controller
+// (see aseba_shm.h).
+class CommandRing {
+ public:
+  bool open(const std::string & name, unsigned min_capacity);
+  void close();
+  bool is_open() const { return bool(memory); }
+
+  // Calls `execute` on the commands queued for `step` or before, in order.
+  // Stops at the first command for a later step.
+  template <typename F>
+  size_t drain(uint64_t step, F && execute) {
+    if (!header) return 0;
+    // NOTE(Jerome): the header is writable by the controller: do not trust it
+    // to stay within the ring
+    uint64_t tail = consumed;
+    const uint64_t head =
+        std::min(SharedMemory::load_acquire(&header->head), tail + capacity);
+    const aseba_shm_command_t * commands = aseba_shm_ring_commands(header);
+    size_t number = 0;
+    for (; tail < head; tail++, number++) {
+      const aseba_shm_command_t command = commands[tail & (capacity - 1)];
+      if (command.step > step) break;
+      execute(command);
+    }
+    consumed = tail;
+    SharedMemory::store_release(&header->tail, tail);
+    return number;
+  }
+
+ private:
+  std::unique_ptr<SharedMemory> memory;
+  aseba_shm_ring_header_t * header = nullptr;
+  uint64_t capacity = 0;
+  uint64_t consumed = 0;
+};
+
+#endif // COMMAND_RING_H_INCLUDED
@@ -1,7 +1,11 @@
 #ifndef COPPELIASIM_ASEBA_NODE_H_INCLUDED
 #define COPPELIASIM_ASEBA_NODE_H_INCLUDED
 
-#include <stack>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <numeric>
+#include <utility>
 #include <vector>
 #include <cstdint>
 
@@ -13,36 +17,63 @@ struct LuaFunction {
   unsigned script_id;
   const std::string name;
   const std::vector<int> argument_sizes;
+  // the sum of the argument sizes
+  const size_t size;
+  // in DeferredCalls (-1 until first deferred)
+  int batch;
   LuaFunction(
       unsigned script_id, const std::string & name, const std::vector<int> & argument_sizes) :
-      script_id(script_id), name(name), argument_sizes(argument_sizes) {}
+      script_id(script_id), name(name), argument_sizes(argument_sizes),
+      size(std::accumulate(argument_sizes.begin(), argument_sizes.end(), size_t(0))),
+      batch(-1) {}
+};
+
+// Calls of Lua functions from all nodes, collected during a step and then
+// delivered with one script call per function (see `flush`).
+class DeferredCalls {
+ public:
+  ~DeferredCalls();
+  void push(LuaFunction & function, const AsebaVMState * vm, const uint16_t * addresses);
+  // Calls `function(ids, values)` for each function with pending calls: `ids` holds the node
+  // of each call and `values` the arguments of all calls, one after the other.
+  // If the function returns a table of the same size, the arguments are updated with it.
+  void flush();
+
+ private:
+  struct Batch {
+    unsigned script_id;
+    std::string name;
+    std::vector<int> argument_sizes;
+    size_t size;
+    std::vector<int> ids;
+    std::vector<int32_t> values;
+    // the address of each argument
+    std::vector<uint16_t> addresses;
+  };
+  std::vector<Batch> batches;
+  std::map<std::pair<unsigned, std::string>, int> batch_index;
+  int stack_id = -1;
 };
 
 class CoppeliaSimAsebaNode : public DynamicAsebaNode {
  private:
   std::vector<LuaFunction> lua_functions;
   unsigned script_id;
-
- protected:
-  void free_descriptions()
-  {
-    for (size_t i = 0; i < lua_functions.size(); i++) {
-      AsebaNativeFunctionDescription *function = functions_description[number_of_native_function + i];
-      free((void *)function->name);
-      free((void *)function->doc);
-      AsebaNativeFunctionArgumentDescription* arg = function->arguments;
-      for (; arg->size; arg++) {
-        free((void* )arg->name);
-      }
-      free(function);
-    }
-    DynamicAsebaNode::free_descriptions();
-  }
+  // reused between calls
+  int stack_id = -1;
+  std::vector<uint16_t> addresses;
+  std::vector<int32_t> values;
 
 public:
+  // When set, calls of Lua functions are queued instead of being executed immediately
+  static inline DeferredCalls * deferred_calls = nullptr;
 
   using DynamicAsebaNode::DynamicAsebaNode;
 
+  ~CoppeliaSimAsebaNode() {
+    if (stack_id >= 0) simReleaseStack(stack_id);
+  }
+
   void set_script_id(unsigned id) {
     script_id = id;
   }
@@ -60,84 +91,57 @@ public:
         return;
       }
     }
-    size_t number = lua_functions.size() + number_of_native_function;
     std::vector<int> sizes;
-    functions_description = (AsebaNativeFunctionDescription **) realloc(functions_description, (number + 2) * sizeof(AsebaNativeFunctionDescription*));
-    if(!functions_description)
-    {
-      log_warn("Failed to realloc functions_description!");
-      return;
-    }
-    AsebaNativeFunctionDescription * desc = (AsebaNativeFunctionDescription *) malloc(sizeof(AsebaNativeFunctionDescription) + (1 + arguments.size()) * sizeof(AsebaNativeFunctionArgumentDescription));
-    if(!desc)
-    {
-        log_warn("Failed to malloc AsebaNativeFunctionDescription!");
-        return;
-    }
-    desc->name = dydata(name);
-    desc->doc = dydata(description);
-    AsebaNativeFunctionArgumentDescription* arg = desc->arguments;
     for(auto &v : arguments)
     {
-      arg->name = dydata(std::get<1>(v));
-      arg->size = std::get<0>(v);
-      sizes.push_back(arg->size);
-      arg++;
+      sizes.push_back(std::get<0>(v));
     }
-    arg->name = NULL;
-    arg->size = 0;
-    functions_description[number] = desc;
-    functions_description[number+1] = NULL;
+    own_descriptions().add_function(name, description, arguments);
     lua_functions.emplace_back(script_id, callback_name, sizes);
     log_debug("Added function");
   }
 
   void call_function(AsebaVMState *vm, unsigned id) override {
-    if (id < lua_functions.size()) {
-      int stack_id = simCreateStack();
-      // How many arguments?
-      auto & function = lua_functions[id];
-      int number_of_arguments = function.argument_sizes.size();
-      std::stack<uint16_t> addresses;
-      // TODO(Jerome): take into account dynamic lengths (i.e. size = -1, -2 , ...)
-      for (auto size : function.argument_sizes) {
-        uint16_t address = AsebaNativePopArg(vm);
-        addresses.push(address);
-        // TODO(Jerome): variable length arrays are not part of any C++ standart!
-        // Replace witha a vector -> vector.data ~(or array) no, it only accept
-        // const expr as sizes~ int32_t values[size];
-        std::vector<int32_t> values(size);
-        for (size_t i = 0; i < size; i++) {
-          values[i] = (int32_t)vm->variables[address + i];
-        }
-        simPushInt32TableOntoStack(stack_id, values.data(), size);
-        // printf("IN [%d] = [%d, ...]\n", address, values[0]);
-      }
-      // printf("IN stack size %d\n", simGetStackSize(stack_id));
-      log_debug("Will call lua function %s for script %d with %d arguments",
-                function.name.c_str(), function.script_id, number_of_arguments);
-      int res = simCallScriptFunctionEx(function.script_id, function.name.c_str(), stack_id);
-      log_debug("Has called lua function -> %d", res);
-      int number_of_results = simGetStackSize(stack_id);
-      // printf("OUT stack size %d\n", number_of_results);
-      int num = std::min(number_of_arguments, number_of_results);
-      for (int i = 0; i < num; i++) {
-        int size = function.argument_sizes[number_of_arguments - i - 1];
-        uint16_t address = addresses.top();
-        // int32_t values[size];
-        // TODO(Jerome): check that it works!!!
-        std::vector<int32_t> values(size);
-        simGetStackInt32Table(stack_id, values.data(), size);
-        // printf("OUT [%d] = [%d, ...]\n", address, values[0]);
-        for (size_t i = 0; i < size; i++) {
-          // TODO(Jerome): check that the casting is correct
-          vm->variables[address + i] = (uint16_t)values[i];
-        }
-        simPopStackItem(stack_id, 1);
-        addresses.pop();
-      }
-      simReleaseStack(stack_id);
+    if (id >= lua_functions.size()) return;
+    auto & function = lua_functions[id];
+    const size_t number_of_arguments = function.argument_sizes.size();
+    // TODO(Jerome): take into account dynamic lengths (i.e. size = -1, -2 , ...)
+    addresses.resize(number_of_arguments);
+    for (size_t i = 0; i < number_of_arguments; i++) {
+      addresses[i] = AsebaNativePopArg(vm);
+    }
+    stats.lua_calls++;
+    if (deferred_calls) {
+      deferred_calls->push(function, vm, addresses.data());
+      return;
+    }
+    if (stack_id < 0) stack_id = simCreateStack();
+    for (size_t i = 0; i < number_of_arguments; i++) {
+      const int size = function.argument_sizes[i];
+      values.resize(size);
+      std::copy_n(vm->variables + addresses[i], size, values.begin());
+      simPushInt32TableOntoStack(stack_id, values.data(), size);
+    }
+    log_debug("Will call lua function %s for script %d with %lu arguments",
+              function.name.c_str(), function.script_id, number_of_arguments);
+    const auto start = std::chrono::steady_clock::now();
+    int res = simCallScriptFunctionEx(function.script_id, function.name.c_str(), stack_id);
+    stats.lua_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log_debug("Has called lua function -> %d", res);
+    // results are popped from the last argument
+    const int stack_size = simGetStackSize(stack_id);
+    const size_t number_of_results = std::min<size_t>(number_of_arguments, std::max(stack_size, 0));
+    for (size_t i = 0; i < number_of_results; i++) {
+      const size_t j = number_of_arguments - i - 1;
+      const int size = function.argument_sizes[j];
+      values.resize(size);
+      simGetStackInt32Table(stack_id, values.data(), size);
+      // TODO(Jerome): check that the casting is correct
+      std::copy_n(values.begin(), size, vm->variables + addresses[j]);
+      simPopStackItem(stack_id, 1);
     }
+    // empty the stack for the next call
+    simPopStackItem(stack_id, 0);
   }
 };
 
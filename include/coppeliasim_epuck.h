@@ -8,6 +8,7 @@
 
 #include <simPlusPlus/Lib.h>
 #include <opencv2/opencv.hpp>
+#include "camera_export.h"
 #include "coppeliasim_robot.h"
 
 namespace CS {
@@ -18,17 +19,27 @@ struct Camera {
   int image_height;
   std::vector<uint8_t> image;
   bool active;
+  // When set, frames are written directly in the ring `channel` of `output`
+  // instead of in `image`.
+  CameraExport * output;
+  int channel;
+
+  static constexpr int width = 60;
+  static constexpr int height = 60;
 
   void update_sensing(float dt);
+  void set_output(CameraExport * value, int index);
 
   const uint8_t * get_line(float y) const {
     int i = std::clamp<int>(image_height * y, 0, image_height - 1);
-    return image.data() +  image_width * i * 3;
+    const uint8_t * frame = output ? output->last_frame(channel) : image.data();
+    if (!frame) frame = image.data();
+    return frame + image_width * i * 3;
   }
 
   Camera(int handle=-1) :
-    handle(handle), image_width(60), image_height(60), image(image_width * image_height * 3),
-    active(true) {}
+    handle(handle), image_width(width), image_height(height),
+    image(image_width * image_height * 3), active(true), output(nullptr), channel(-1) {}
 };
 
 struct Gyroscope {
@@ -165,6 +176,14 @@ class EPuck : public Robot {
   void enable_camera(bool value) {
     camera.active = true;
   }
+
+  // Pass nullptr to stop exporting frames
+  void set_camera_output(CameraExport * output, int channel) {
+    camera.set_output(output, channel);
+  }
+  int get_camera_channel() const {
+    return camera.output ? camera.channel : -1;
+  }
 };
 
 }
@@ -2,7 +2,11 @@
 #define COPPELIASIM_ROBOT_H
 
 #include <array>
+#include <map>
 #include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
 #include <fstream>
 #include <filesystem>
 
@@ -88,7 +92,7 @@ struct GroundSensor {
   float max_value;
   float x0;
   void update_sensing(float dt);
-  GroundSensor(int handle_=-1);
+  GroundSensor(int handle_=-1, int vision_handle_=-1);
 private:
   int vision_handle;
 };
@@ -97,7 +101,7 @@ struct Accelerometer {
   float values[3];
   int handle;
   bool active;
-  Accelerometer(int handle_=-1);
+  Accelerometer(int handle_=-1, int sensor_=-1, int mass_handle=-1);
   void update_sensing(float dt);
 private:
   simFloat mass;
@@ -138,6 +142,28 @@ struct Color {
   }
 };
 
+// Resolves the handles of the parts of a model from paths relative to the model base
+// (e.g., "/LeftMotor").
+//
+// The position of each part in the model tree is cached per model (type, alias and number
+// of objects), so that further instances of the same model are resolved without any path
+// lookup. If an instance does not match the cached layout (e.g., because it has been edited),
+// it falls back to resolving the paths.
+class ModelLayout {
+ public:
+  static std::vector<int> resolve(int handle, const std::string & model,
+                                  const std::vector<std::string> & paths);
+ private:
+  // (model type, alias of the base, number of objects in the tree)
+  using Key = std::tuple<std::string, std::string, int>;
+  struct Template {
+    // position in the tree (or -1 if missing) and type of each part
+    std::vector<int> indices;
+    std::vector<int> types;
+  };
+  inline static std::map<Key, Template> templates;
+};
+
 class Robot {
 
  protected:
@@ -216,6 +242,23 @@ class Robot {
 
   void reset();
 
+  // Fields of the observations (a bit mask), written in this order:
+  // per wheel speed, per proximity sensor value, per ground sensor reflected light,
+  // 3 accelerations, per wheel odometry.
+  enum Observation {
+    OBSERVATION_SPEED = 1 << 0,
+    OBSERVATION_PROXIMITY = 1 << 1,
+    OBSERVATION_GROUND = 1 << 2,
+    OBSERVATION_ACCELERATION = 1 << 3,
+    OBSERVATION_ODOMETRY = 1 << 4,
+  };
+  // Number of floats written by `write_observations`
+  size_t observations_size(unsigned fields) const;
+  // Returns the end of the written values
+  float * write_observations(unsigned fields, float * buffer) const;
+  // In the world frame
+  void get_pose(float position[3], float orientation[3]) const;
+
 };
 
 }
@@ -1,14 +1,62 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+// Messages below this level are compiled out:
+// 0 (debug), 1 (info), 2 (warnings), 3 (errors), 4 (none)
+#ifndef ASEBA_LOG_LEVEL
+#define ASEBA_LOG_LEVEL 0
+#endif
+
 #ifndef LOG_PRINT
 
 #pragma warning(disable : 4996)
 
+#include <atomic>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "simPlusPlus/Lib.h"
 
+namespace Logging {
+
+// The highest verbosity shown by CoppeliaSim for this plugin (see `refresh_verbosity`)
+inline std::atomic<int> verbosity{sim_verbosity_debug};
+
+inline bool enabled(int level) {
+  return level <= verbosity.load(std::memory_order_relaxed);
+}
+
+// Reads the verbosity of the plugin from CoppeliaSim. Called from the simulation thread.
+void refresh_verbosity();
+// Where messages go: if `path` is not empty, to a file written by a background thread,
+// else to CoppeliaSim, either immediately or, if `asynchronous`, in batches (see `flush`).
+// Messages written by other threads than the simulation thread are always batched.
+bool configure(const std::string & path, bool asynchronous);
+void write(int verbosity, std::string && message);
+// Adds the queued messages to the CoppeliaSim log. Called from the simulation thread.
+void flush();
+
+struct Message {
+  int verbosity;
+  std::string text;
+};
+
+// While alive, the messages written by the current thread are appended to `messages`
+// instead, for a worker to pass them to the simulation thread.
+class Capture {
+ public:
+  explicit Capture(std::vector<Message> & messages);
+  ~Capture();
+  Capture(const Capture &) = delete;
+  Capture & operator=(const Capture &) = delete;
+
+ private:
+  std::vector<Message> * previous;
+};
+
+}  // namespace Logging
+
 // template<typename ... Args>
 // void log(simInt verbosity, const char * format, Args ... args) {
 //   int size_s = std::snprintf(nullptr, 0, format, args ...) + 1;
@@ -19,40 +67,52 @@
 //   delete[] buf;
 // }
 
+// NOTE(Jerome): the verbosity is checked before formatting the message,
+// and before copying the format to a string
 template <typename... Args>
-void log(int verbosity, const std::string &format, Args &&...args) {
-  simAddLog(PLUGIN_NAME_XML, verbosity,
-            sim::util::sprintf(format, std::forward<Args>(args)...).c_str());
+void log(int verbosity, const char *format, Args &&...args) {
+  if (!Logging::enabled(verbosity)) return;
+  Logging::write(verbosity, sim::util::sprintf(format, std::forward<Args>(args)...));
 }
 
-#define log_debug(...) log(sim_verbosity_debug, __VA_ARGS__)
-#define log_info(...) log(sim_verbosity_infos, __VA_ARGS__)
-#define log_warn(...) log(sim_verbosity_warnings, __VA_ARGS__)
-#define log_error(...) log(sim_verbosity_errors, __VA_ARGS__)
+#define LOG_DEBUG_(...) log(sim_verbosity_debug, __VA_ARGS__)
+#define LOG_INFO_(...) log(sim_verbosity_infos, __VA_ARGS__)
+#define LOG_WARN_(...) log(sim_verbosity_warnings, __VA_ARGS__)
+#define LOG_ERROR_(...) log(sim_verbosity_errors, __VA_ARGS__)
 
 #else
 
-#define log_debug(...)                                                         \
-  {                                                                            \
-    printf(__VA_ARGS__);                                                       \
-    printf("\n");                                                              \
-  }
-#define log_info(...)                                                          \
-  {                                                                            \
-    printf(__VA_ARGS__);                                                       \
-    printf("\n");                                                              \
-  }
-#define log_warn(...)                                                          \
-  {                                                                            \
-    printf(__VA_ARGS__);                                                       \
-    printf("\n");                                                              \
-  }
-#define log_error(...)                                                         \
+#define LOG_PRINT_(...)                                                        \
   {                                                                            \
     printf(__VA_ARGS__);                                                       \
     printf("\n");                                                              \
   }
+#define LOG_DEBUG_(...) LOG_PRINT_(__VA_ARGS__)
+#define LOG_INFO_(...) LOG_PRINT_(__VA_ARGS__)
+#define LOG_WARN_(...) LOG_PRINT_(__VA_ARGS__)
+#define LOG_ERROR_(...) LOG_PRINT_(__VA_ARGS__)
+
+#endif
 
+#if ASEBA_LOG_LEVEL <= 0
+#define log_debug(...) LOG_DEBUG_(__VA_ARGS__)
+#else
+#define log_debug(...) ((void)0)
+#endif
+#if ASEBA_LOG_LEVEL <= 1
+#define log_info(...) LOG_INFO_(__VA_ARGS__)
+#else
+#define log_info(...) ((void)0)
+#endif
+#if ASEBA_LOG_LEVEL <= 2
+#define log_warn(...) LOG_WARN_(__VA_ARGS__)
+#else
+#define log_warn(...) ((void)0)
+#endif
+#if ASEBA_LOG_LEVEL <= 3
+#define log_error(...) LOG_ERROR_(__VA_ARGS__)
+#else
+#define log_error(...) ((void)0)
 #endif
 
 #endif /* end of include guard: LOGGING_H */
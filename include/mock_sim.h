@@ -0,0 +1,29 @@
+#ifndef MOCK_SIM_H_INCLUDED
+#define MOCK_SIM_H_INCLUDED
+
+#include <string>
+
+// A tiny in-memory scene behind the subset of the CoppeliaSim API used by the robot models
+// (`CS::Thymio2`, `CS::EPuck` and their sensors), to run them without a simulator,
+// e.g., in benchmarks. Link mock_sim.cpp instead of the CoppeliaSim library.
+//
+// Models are flat: a base with all the parts of the robot, which are found by path
+// as in the real models. Bodies are spheres lying on an infinite floor: proximity sensors
+// cast one ray along their z-axis against them. Robots do not move.
+namespace MockSim {
+
+// Removes all objects and textures and resets the time
+void clear();
+// Returns the handle of the base of a new robot at (x, y) [m] with yaw [rad]
+int add_thymio2(double x, double y, double yaw = 0.0);
+int add_epuck(double x, double y, double yaw = 0.0);
+// Advances the time and the joints
+void step(double dt);
+double time();
+size_t number_of_objects();
+// Where the robots load their textures from, i.e., the CoppeliaSim "modelPath"
+void set_model_path(const std::string & path);
+
+}  // namespace MockSim
+
+#endif // MOCK_SIM_H_INCLUDED
@@ -0,0 +1,68 @@
+#ifndef OUTBOUND_QUEUE_H_INCLUDED
+#define OUTBOUND_QUEUE_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "dashel/dashel.h"
+
+// The messages waiting to be written to the client of a network.
+//
+// Only messages that stream values can be dropped or coalesced: user events and replies
+// to `GET_VARIABLES`. Any other message (descriptions, execution states, ...) is always kept,
+// even beyond the capacity.
+//
+// Used by the thread that uses the hub of the networks; the statistics can be read by any thread.
+class OutboundQueue {
+ public:
+  enum Policy {
+    // write all messages, even if the client is slow to read them
+    BLOCK = 0,
+    // when full, drop the oldest message that can be dropped
+    DROP_OLDEST = 1,
+    // keep only the latest message for each node, type (and range of variables),
+    // in the place of the first one; when full, drop the oldest as with `DROP_OLDEST`
+    LATEST = 2
+  };
+
+  Policy policy = BLOCK;
+  size_t capacity = 256;
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> coalesced{0};
+  std::atomic<size_t> max_depth{0};
+
+  // Whether the policy may drop `frame`, a complete message: size, source, type and payload
+  static bool droppable(const std::vector<uint8_t> & frame);
+  // Writes messages, blocking until they are all written. Returns false if the stream failed.
+  static bool write_all(Dashel::Stream * stream, const std::vector<std::vector<uint8_t>> & frames);
+
+  void push(std::vector<uint8_t> && frame);
+  // Writes the queued messages, without blocking unless the policy is `BLOCK`.
+  // Returns false if the stream failed.
+  bool write(Dashel::Stream * stream);
+  // Moves all queued messages to `frames`, e.g., to write them without holding a lock
+  void take(std::vector<std::vector<uint8_t>> & frames);
+  void clear();
+  size_t size() const { return depth.load(std::memory_order_relaxed); }
+
+ private:
+  struct Message {
+    std::vector<uint8_t> frame;
+    // to coalesce messages, 0 if the message cannot be dropped
+    uint64_t key;
+  };
+  std::list<Message> messages;
+  // key -> queued message
+  std::map<uint64_t, std::list<Message>::iterator> latest;
+  // the size of `messages`, for other threads
+  std::atomic<size_t> depth{0};
+
+  void drop_oldest();
+  void update_depth();
+};
+
+#endif // OUTBOUND_QUEUE_H_INCLUDED
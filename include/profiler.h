@@ -0,0 +1,75 @@
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The phases of a simulation step timed by the profiler.
+// Phases may be nested (e.g., VM runs happen during Dashel I/O): each is timed inclusively.
+enum class ProfilePhase : unsigned {
+  STEP,
+  STANDALONE_ROBOTS,
+  PROX_COMM,
+  SPIN,
+  DASHEL,
+  SENSING,
+  VM,
+  ACTUATION,
+  TEXTURES,
+  COUNT
+};
+
+// Aggregates the durations of the phases in histograms.
+// Timers are compiled only with ASEBA_PROFILING and record only when enabled.
+class Profiler {
+ public:
+  // durations in microseconds
+  struct Summary {
+    std::string phase;
+    uint64_t count;
+    float min;
+    float mean;
+    float p99;
+    float max;
+  };
+
+  inline static bool enabled = false;
+
+  static void configure(bool enabled, unsigned log_period);
+  static void reset();
+  static std::vector<Summary> summary();
+  // Called at the end of each step: logs a summary every `log_period` steps
+  static void end_step();
+
+  // in ticks, see `ticks_per_us`
+  static uint64_t now();
+  static void record(ProfilePhase phase, uint64_t ticks);
+};
+
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfilePhase phase)
+      : phase(phase), start(Profiler::enabled ? Profiler::now() : 0) {}
+  ~ProfileScope() {
+    if (start) Profiler::record(phase, Profiler::now() - start);
+  }
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope & operator=(const ProfileScope &) = delete;
+
+ private:
+  ProfilePhase phase;
+  uint64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef ASEBA_PROFILING
+#define PROFILE_SCOPE(phase) \
+  ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(ProfilePhase::phase)
+#else
+#define PROFILE_SCOPE(phase)
+#endif
+
+#endif // PROFILER_H_INCLUDED
@@ -0,0 +1,37 @@
+#ifndef SHARED_MEMORY_H_INCLUDED
+#define SHARED_MEMORY_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// A named region of shared memory, created by this process
+// and removed when released.
+class SharedMemory {
+ public:
+  // Returns nullptr on failure
+  static std::unique_ptr<SharedMemory> create(const std::string & name, size_t size);
+  ~SharedMemory();
+  SharedMemory(const SharedMemory &) = delete;
+  SharedMemory & operator=(const SharedMemory &) = delete;
+
+  char * data() const { return memory; }
+  size_t size() const { return length; }
+  const std::string & get_name() const { return name; }
+
+  // To synchronize with the other processes
+  static uint64_t load_acquire(const uint64_t * value);
+  static void store_release(uint64_t * target, uint64_t value);
+  static void fence_release();
+
+ private:
+  SharedMemory(const std::string & name, char * memory, size_t size, void * handle);
+  std::string name;
+  char * memory;
+  size_t length;
+  // the file mapping (Windows only)
+  void * handle;
+};
+
+#endif // SHARED_MEMORY_H_INCLUDED
@@ -0,0 +1,55 @@
+#ifndef SPSC_QUEUE_H_INCLUDED
+#define SPSC_QUEUE_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// A bounded FIFO between exactly one producer thread and one consumer thread, without locks.
+// The producer is the only one to write `head` and the consumer the only one to write `tail`,
+// as in the command ring of aseba_shm.h.
+template <typename T>
+class SPSCQueue {
+ public:
+  // The capacity is rounded up to a power of two
+  explicit SPSCQueue(size_t min_capacity) {
+    size_t size = 1;
+    while (size < min_capacity) size <<= 1;
+    items.resize(size);
+    mask = size - 1;
+  }
+
+  size_t capacity() const { return items.size(); }
+
+  size_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+  // Called by the producer. Returns false (and leaves `item` untouched) if the queue is full.
+  bool push(T && item) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == items.size()) return false;
+    items[h & mask] = std::move(item);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer. Returns false if the queue is empty.
+  bool pop(T & item) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    item = std::move(items[t & mask]);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  std::vector<T> items;
+  size_t mask;
+  // on different cache lines, so that the two threads do not share one
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif // SPSC_QUEUE_H_INCLUDED
@@ -0,0 +1,44 @@
+#ifndef STATE_MIRROR_H_INCLUDED
+#define STATE_MIRROR_H_INCLUDED
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "aseba_shm.h"
+#include "coppeliasim_epuck.h"
+#include "coppeliasim_thymio2.h"
+#include "shared_memory.h"
+
+class AsebaDescriptionTables;
+
+// Publishes the state of all robots to shared memory at each step, to be read
+// by other processes (see aseba_shm.h for the layout).
+class StateMirror {
+ public:
+  bool open(const std::string & name, unsigned max_robots,
+            const std::vector<std::string> & variables, const std::vector<int> & sizes);
+  void close();
+  bool is_open() const { return bool(memory); }
+  void publish(const std::map<int, CS::Thymio2> & thymios,
+               const std::map<int, CS::EPuck> & epucks, uint64_t simulation_step, double time);
+
+ private:
+  std::unique_ptr<SharedMemory> memory;
+  aseba_shm_header_t * header = nullptr;
+  // the number of frames written so far
+  uint64_t sequence = 0;
+  // the location of the selected variables in the memory of each node
+  struct NodeVariables {
+    std::shared_ptr<const AsebaDescriptionTables> descriptions;
+    std::vector<std::pair<unsigned, unsigned>> locations;
+  };
+  std::map<int, NodeVariables> node_variables;
+
+  aseba_shm_robot_t * record(aseba_shm_frame_t * frame, unsigned index) const;
+  void write_variables(int uid, int16_t * values);
+};
+
+#endif // STATE_MIRROR_H_INCLUDED
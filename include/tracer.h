@@ -0,0 +1,55 @@
+#ifndef TRACER_H_INCLUDED
+#define TRACER_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Records the activity of the plugin on a timeline, to be inspected in a trace viewer
+// (chrome://tracing or https://ui.perfetto.dev). Each thread writes its events to its own
+// ring, without locks; when a ring is full, the oldest events are overwritten.
+// Events are compiled only with ASEBA_TRACING and recorded only between `start` and `stop`.
+class Tracer {
+ public:
+  inline static std::atomic<bool> enabled{false};
+
+  // `capacity` is the number of events kept per thread
+  static void start(size_t capacity);
+  static void stop();
+  // Writes the recorded events as Chrome trace JSON.
+  // Returns the number of events written, or -1 on failure.
+  static long dump(const std::string & path);
+
+  static uint64_t now();
+  // `name` must be a string literal
+  static void record(const char * name, int id, int arg, uint64_t begin, uint64_t end);
+};
+
+class TraceScope {
+ public:
+  explicit TraceScope(const char * name, int id = -1, int arg = -1)
+      : name(name), id(id), arg(arg),
+        begin(Tracer::enabled.load(std::memory_order_relaxed) ? Tracer::now() : 0) {}
+  ~TraceScope() {
+    if (begin) Tracer::record(name, id, arg, begin, Tracer::now());
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope & operator=(const TraceScope &) = delete;
+
+ private:
+  const char * name;
+  int id;
+  int arg;
+  uint64_t begin;
+};
+
+#ifdef ASEBA_TRACING
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SCOPE(...)
+#endif
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#endif // TRACER_H_INCLUDED
@@ -0,0 +1,56 @@
+#ifndef VARIABLE_WATCHES_H_INCLUDED
+#define VARIABLE_WATCHES_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Watches ranges of Aseba variables and records the values that changed since
+// the previous check, so that scripts do not need to poll them at every step.
+class VariableWatches {
+ public:
+  // Returns the id of the new watch, or -1 if the node has no such variable.
+  // A negative size watches the variable from `start` to its end.
+  int add(int node_id, unsigned variable_handle, unsigned start, int size);
+  bool remove(int watch);
+  void remove_node(int node_id);
+  void clear();
+  bool empty() const { return nodes.empty(); }
+
+  // Compares the watched ranges with their previous values and records those that changed.
+  // Recording stops when `capacity` changes are pending.
+  void check();
+  void set_capacity(size_t value) { capacity = value; }
+
+  // Pending changes: watch i changed to the next `sizes[i]` elements of `values`
+  bool has_changes() const { return !watches.empty(); }
+  const std::vector<int> & changed_watches() const { return watches; }
+  const std::vector<int> & changed_sizes() const { return sizes; }
+  const std::vector<int> & changed_values() const { return values; }
+  void clear_changes();
+
+ private:
+  struct Watch {
+    int id;
+    unsigned handle;
+    unsigned start;
+    unsigned size;
+    // of the previous values in `slab`
+    size_t offset;
+  };
+  // node id -> watches
+  std::map<int, std::vector<Watch>> nodes;
+  // the previous values of all watched ranges, contiguous
+  std::vector<int16_t> slab;
+  int next_id = 0;
+  size_t capacity = 4096;
+  bool overflow = false;
+  std::vector<int> watches;
+  std::vector<int> sizes;
+  std::vector<int> values;
+
+  void compact();
+};
+
+#endif // VARIABLE_WATCHES_H_INCLUDED
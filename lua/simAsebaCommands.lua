@@ -0,0 +1,121 @@
+-- Record plugin commands in a buffer and execute them in a single call.
+--
+--   local simAsebaCommands = require('simAsebaCommands')
+--   local commands = simAsebaCommands.new()
+--   commands:add('set_variable', id, 'x', {1, 2})
+--   commands:add('_thymio2_set_button', id, 0, true)
+--   commands:add('get_variable', id, 'y')
+--   local results, err = commands:execute()
+--   -- results[3].value is the value of y
+--
+-- Commands use the names and the arguments of lua/callbacks.xml; missing trailing
+-- arguments take their default values.
+
+local simAseba = require('simAseba')
+local spec = require('simAsebaCommands-spec')
+
+local simAsebaCommands = {}
+
+local formats = {int = '=i4', float = '=f', double = '=d', string = '=s4', buffer = '=s4'}
+
+local function encode(chunks, dtype, value)
+    if dtype == 'bool' then
+        chunks[#chunks + 1] = string.pack('=B', value and 1 or 0)
+    elseif formats[dtype] then
+        chunks[#chunks + 1] = string.pack(formats[dtype], value)
+    elseif dtype:sub(1, 6) == 'table:' then
+        local itype = dtype:sub(7)
+        chunks[#chunks + 1] = string.pack('=I4', #value)
+        for _, item in ipairs(value) do
+            encode(chunks, itype, item)
+        end
+    elseif spec.structs[dtype] then
+        for _, field in ipairs(spec.structs[dtype]) do
+            encode(chunks, field[2], value[field[1]])
+        end
+    else
+        error('Unsupported type ' .. dtype)
+    end
+end
+
+local function decode(data, position, dtype)
+    if dtype == 'bool' then
+        local value
+        value, position = string.unpack('=B', data, position)
+        return value ~= 0, position
+    elseif formats[dtype] then
+        return string.unpack(formats[dtype], data, position)
+    elseif dtype:sub(1, 6) == 'table:' then
+        local itype = dtype:sub(7)
+        local size
+        size, position = string.unpack('=I4', data, position)
+        local value = {}
+        for i = 1, size do
+            value[i], position = decode(data, position, itype)
+        end
+        return value, position
+    elseif spec.structs[dtype] then
+        local value = {}
+        for _, field in ipairs(spec.structs[dtype]) do
+            value[field[1]], position = decode(data, position, field[2])
+        end
+        return value, position
+    end
+    error('Unsupported type ' .. dtype)
+end
+
+local Buffer = {}
+Buffer.__index = Buffer
+
+function simAsebaCommands.new()
+    return setmetatable({chunks = {}, names = {}}, Buffer)
+end
+
+function Buffer:add(name, ...)
+    local command = spec.commands[name]
+    if not command then
+        error('Unknown command ' .. tostring(name))
+    end
+    local number = math.min(select('#', ...), #command.params)
+    self.chunks[#self.chunks + 1] = string.pack('=I2B', command.opcode, number)
+    for i = 1, number do
+        encode(self.chunks, command.params[i][2], select(i, ...))
+    end
+    self.names[#self.names + 1] = name
+end
+
+function Buffer:clear()
+    self.chunks = {}
+    self.names = {}
+end
+
+function Buffer:data()
+    return table.concat(self.chunks)
+end
+
+-- Returns a table with the results of each executed command (tables keyed by the names
+-- of the return values) and the error message of the first command that failed, if any.
+function Buffer:decode(data)
+    local results = {}
+    local position = 1
+    for i, name in ipairs(self.names) do
+        if position > #data then break end
+        local status
+        status, position = string.unpack('=B', data, position)
+        if status ~= 0 then
+            return results, (string.unpack('=s4', data, position))
+        end
+        local result = {}
+        for _, r in ipairs(spec.commands[name].results) do
+            result[r[1]], position = decode(data, position, r[2])
+        end
+        results[i] = result
+    end
+    return results, nil
+end
+
+function Buffer:execute()
+    return self:decode(simAseba.execute_commands(self:data()))
+end
+
+return simAsebaCommands
@@ -0,0 +1,179 @@
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "aseba_async_script.h"
+#include "aseba_network.h"
+#include "aseba_script.h"
+#include "logging.h"
+
+namespace Aseba {
+
+struct ScriptJob {
+  ScriptResult result;
+  // to check that the node has not been replaced, as a new node may get the same address
+  uint64_t node_serial;
+  unsigned node_id;
+  std::string node_name;
+  // immutable, so it can be read by the worker while the node changes
+  std::shared_ptr<const Aseba::TargetDescription> description;
+  std::string source;
+  bool from_file;
+  Aseba::BytecodeVector bytecode;
+  unsigned generation;
+  // logged by the simulation thread when installing the script
+  std::vector<Logging::Message> log;
+};
+
+static std::mutex mutex;
+static std::condition_variable condition;
+static std::thread worker;
+static bool stopping = false;
+// incremented on cancel, to discard the results of jobs that were being compiled
+static unsigned generation = 0;
+static int next_ticket = 1;
+static std::deque<ScriptJob> queued;
+static std::vector<ScriptJob> compiled;
+static std::map<int, std::pair<ScriptStatus, std::string>> statuses;
+
+static void compile_job(ScriptJob &job) {
+  // NOTE(Jerome): the worker must not call CoppeliaSim
+  Logging::Capture capture(job.log);
+  std::shared_ptr<AsebaScript> script;
+  if (job.from_file) {
+    script = AsebaScript::from_file(job.source);
+  } else {
+    script = AsebaScript::from_code_string(job.source, job.node_name, job.node_id);
+  }
+  if (!script) {
+    job.result.success = false;
+    job.result.message = "Failed to load script";
+    return;
+  }
+  Aseba::VariablesMap user_variables;
+  job.result.success = script->compile(job.node_id, job.description.get(), user_variables,
+                                       job.bytecode, &job.result.message);
+}
+
+static void run_worker() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    condition.wait(lock, [] { return stopping || !queued.empty(); });
+    if (stopping) return;
+    ScriptJob job = std::move(queued.front());
+    queued.pop_front();
+    lock.unlock();
+    compile_job(job);
+    lock.lock();
+    if (job.generation != generation) continue;
+    statuses[job.result.ticket] =
+        std::make_pair(job.result.success ? SCRIPT_COMPILED : SCRIPT_FAILED, job.result.message);
+    compiled.push_back(std::move(job));
+  }
+}
+
+int compile_script_async(DynamicAsebaNode *node, int node_handle, const std::string &source,
+                         bool from_file, int script_id, const std::string &callback) {
+  ScriptJob job;
+  job.node_serial = node->serial;
+  job.node_id = node->vm.nodeId;
+  job.node_name = node->name;
+  job.description = node->get_description();
+  job.source = source;
+  job.from_file = from_file;
+  job.result.node_handle = node_handle;
+  job.result.success = false;
+  job.result.script_id = script_id;
+  job.result.callback = callback;
+  std::lock_guard<std::mutex> lock(mutex);
+  const int ticket = next_ticket++;
+  job.result.ticket = ticket;
+  job.generation = generation;
+  statuses[ticket] = std::make_pair(SCRIPT_PENDING, std::string());
+  queued.push_back(std::move(job));
+  if (!worker.joinable()) {
+    stopping = false;
+    worker = std::thread(run_worker);
+  }
+  condition.notify_one();
+  log_info("Queued script %d for node %d", ticket, node_handle);
+  return ticket;
+}
+
+std::vector<ScriptResult> install_compiled_scripts() {
+  std::vector<ScriptJob> jobs;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (compiled.empty()) return {};
+    jobs.swap(compiled);
+  }
+  std::vector<ScriptResult> results;
+  for (auto &job : jobs) {
+    for (auto &message : job.log) {
+      Logging::write(message.verbosity, std::move(message.text));
+    }
+    ScriptResult &result = job.result;
+    if (result.success) {
+      DynamicAsebaNode *node = node_with_handle(result.node_handle);
+      if (!node || node->serial != job.node_serial ||
+          node->get_description() != job.description) {
+        result.success = false;
+        result.message = "Node has changed during compilation";
+      } else {
+        log_info("Compiled script %d to %lu bytecodes", result.ticket, job.bytecode.size());
+        node->install_bytecode(job.bytecode);
+      }
+    }
+    if (!result.success) {
+      log_warn("Failed to load script %d to node %d: %s", result.ticket, result.node_handle,
+               result.message.c_str());
+    }
+    results.push_back(result);
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &result : results) {
+    // the ticket may have been forgotten meanwhile
+    auto it = statuses.find(result.ticket);
+    if (it != statuses.end()) {
+      it->second = std::make_pair(result.success ? SCRIPT_LOADED : SCRIPT_FAILED, result.message);
+    }
+  }
+  return results;
+}
+
+ScriptStatus script_status(int ticket, std::string &message) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = statuses.find(ticket);
+  if (it == statuses.end()) {
+    message.clear();
+    return SCRIPT_UNKNOWN;
+  }
+  message = it->second.second;
+  return it->second.first;
+}
+
+void cancel_scripts() {
+  std::lock_guard<std::mutex> lock(mutex);
+  generation++;
+  queued.clear();
+  compiled.clear();
+  statuses.clear();
+}
+
+void stop_script_compiler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    queued.clear();
+    compiled.clear();
+    stopping = true;
+  }
+  condition.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+}
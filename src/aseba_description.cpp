@@ -0,0 +1,141 @@
+#include <cstring>
+#include <unordered_set>
+
+#include "aseba_description.h"
+#include "logging.h"
+
+const char *intern_string(const std::string &value) {
+  // elements of a node-based container never move
+  static std::unordered_set<std::string> pool;
+  return pool.insert(value).first->c_str();
+}
+
+unsigned NameHandles::resolve(const std::string &name) {
+  auto it = handles.find(name);
+  if (it != handles.end()) return it->second;
+  names.push_back(name);
+  return handles[name] = names.size() - 1;
+}
+
+NameHandles &variable_handles() {
+  static NameHandles handles;
+  return handles;
+}
+
+NameHandles &event_handles() {
+  static NameHandles handles;
+  return handles;
+}
+
+AsebaDescriptionTables::AsebaDescriptionTables(const char *name, unsigned variables_capacity)
+    : capacity(variables_capacity), next_variable(0), number_of_variables(0),
+      event_entries{{NULL, NULL}}, function_pointers{NULL} {
+  reserve_variables(1);
+  mutable_variables()->name = name;
+  mutable_variables()->variables[0] = AsebaVariableDescription{0, NULL};
+}
+
+void AsebaDescriptionTables::reserve_variables(size_t number) {
+  const size_t bytes = sizeof(AsebaVMDescription) + number * sizeof(AsebaVariableDescription);
+  const size_t units = (bytes + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+  if (units > variables_storage.size()) {
+    // grow geometrically, so that adding n variables costs O(n)
+    variables_storage.resize(std::max(units, 2 * variables_storage.size()));
+  }
+}
+
+bool AsebaDescriptionTables::append_variable(const char *name, unsigned size) {
+  if (next_variable + size > capacity) {
+    log_warn("Variable %s cannot be added: not enough free space", name);
+    return false;
+  }
+  reserve_variables(number_of_variables + 2);
+  AsebaVariableDescription *entries = mutable_variables()->variables;
+  entries[number_of_variables] = AsebaVariableDescription{(uint16_t)size, name};
+  entries[number_of_variables + 1] = AsebaVariableDescription{0, NULL};
+  number_of_variables++;
+  named_variable[name] = std::make_pair(next_variable, size);
+  next_variable += size;
+  return true;
+}
+
+bool AsebaDescriptionTables::append_event(const char *name, const char *description) {
+  named_event[name] = event_entries.size() - 1;
+  event_entries.back() = AsebaLocalEventDescription{name, description};
+  event_entries.push_back(AsebaLocalEventDescription{NULL, NULL});
+  return true;
+}
+
+bool AsebaDescriptionTables::add_variable(const std::string &name, unsigned size) {
+  if (named_variable.count(name)) {
+    log_warn("Variable %s cannot be added: already defined", name.c_str());
+    return false;
+  }
+  return append_variable(intern_string(name), size);
+}
+
+bool AsebaDescriptionTables::add_event(const std::string &name, const std::string &description) {
+  if (named_event.count(name)) {
+    log_warn("Event %s cannot be added: already defined", name.c_str());
+    return false;
+  }
+  return append_event(intern_string(name), intern_string(description));
+}
+
+bool AsebaDescriptionTables::add_function(
+    const std::string &name, const std::string &description,
+    const std::vector<std::tuple<int, std::string>> &arguments) {
+  const size_t size = sizeof(AsebaNativeFunctionDescription) +
+                      (1 + arguments.size()) * sizeof(AsebaNativeFunctionArgumentDescription);
+  std::shared_ptr<AsebaNativeFunctionDescription> desc(
+      static_cast<AsebaNativeFunctionDescription *>(::operator new(size)),
+      [](AsebaNativeFunctionDescription *d) { ::operator delete(d); });
+  desc->name = intern_string(name);
+  desc->doc = intern_string(description);
+  AsebaNativeFunctionArgumentDescription *arg = desc->arguments;
+  for (const auto &v : arguments) {
+    arg->name = intern_string(std::get<1>(v));
+    arg->size = std::get<0>(v);
+    arg++;
+  }
+  arg->name = NULL;
+  arg->size = 0;
+  function_pointers.back() = desc.get();
+  function_pointers.push_back(NULL);
+  owned_functions.push_back(desc);
+  return true;
+}
+
+std::shared_ptr<const AsebaDescriptionTables> AsebaDescriptionTables::shared(
+    const std::string &name, const AsebaVMDescription *variables,
+    const AsebaLocalEventDescription *events,
+    const AsebaNativeFunctionDescription *const *functions, unsigned variables_capacity) {
+  // NOTE(Jerome): the name is interned, so its pointer identifies it
+  const char *interned_name = intern_string(name);
+  typedef std::tuple<const char *, const void *, const void *, const void *, unsigned> Key;
+  static std::map<Key, std::weak_ptr<const AsebaDescriptionTables>> tables;
+  const Key key{interned_name, variables, events, functions, variables_capacity};
+  auto it = tables.find(key);
+  if (it != tables.end()) {
+    if (auto shared = it->second.lock()) {
+      return shared;
+    }
+  }
+  // names point to the static native descriptions: no copy needed
+  auto t = std::make_shared<AsebaDescriptionTables>(interned_name, variables_capacity);
+  for (const AsebaVariableDescription *v = variables->variables; v->size; v++) {
+    t->append_variable(v->name, v->size);
+  }
+  for (const AsebaLocalEventDescription *e = events; e->name; e++) {
+    t->append_event(e->name, e->doc);
+  }
+  for (const AsebaNativeFunctionDescription *const *f = functions; *f; f++) {
+    t->function_pointers.back() = *f;
+    t->function_pointers.push_back(NULL);
+  }
+  log_debug("Built description tables for %s: %lu variables, %lu events, %lu functions",
+            name.c_str(), t->named_variable.size(), t->named_event.size(),
+            t->number_of_functions());
+  tables[key] = t;
+  return t;
+}
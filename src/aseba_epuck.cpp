@@ -21,18 +21,21 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include "aseba_epuck.h"
 #include "aseba_epuck_natives.h"
+#include "profiler.h"
+#include "tracer.h"
 #include "common/productids.h"
 #include "common/utils/utils.h"
 
 AsebaEPuck::AsebaEPuck(int node_id, const std::string & _name,
                        const std::array<uint8_t, 16> & uuid_,
                        const std::string & friendly_name_):
-  CoppeliaSimAsebaNode(node_id, _name, uuid_, friendly_name_),
+  CoppeliaSimAsebaNode(node_id, _name, uuid_, friendly_name_,
+                       {BYTECODE_SIZE, STACK_SIZE, sizeof(epuck_variables_t) / sizeof(int16_t)}),
   timer(std::bind(&AsebaEPuck::timerTimeout, this), 0),
   timer64Hz(std::bind(&AsebaEPuck::timer64HzTimeout, this), 1.0 / 64.0),
   timer_period(0), camera_line(50), first(true),
   robot(nullptr), is_version_1_3(true) {
-  epuck_variables = reinterpret_cast<epuck_variables_t *>(&variables);
+  epuck_variables = reinterpret_cast<epuck_variables_t *>(variables);
   epuck_variables->id = node_id;
   epuck_variables->productId = ASEBA_PID_EPUCK;
   epuck_variables->camLine = camera_line;
@@ -95,7 +98,11 @@ inline uint16_t aseba_gyro(float speed) {
 
 void AsebaEPuck::step(float dt) {
   // get physical variables
-  robot->update_sensing(dt);
+  {
+    PROFILE_SCOPE(SENSING);
+    TRACE_SCOPE("sensing", vm.nodeId);
+    robot->update_sensing(dt);
+  }
 
   for (size_t i = 0; i < 3; i++) {
     // TODO(Jerome): check orientation
@@ -154,6 +161,8 @@ void AsebaEPuck::step(float dt) {
   motor_right_target = epuck_variables->motorRightTarget;
 
   first = false;
+  PROFILE_SCOPE(ACTUATION);
+  TRACE_SCOPE("actuation", vm.nodeId);
   robot->update_actuation(dt);
 }
 
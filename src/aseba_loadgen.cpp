@@ -0,0 +1,439 @@
+// Generates Aseba traffic towards running networks, like an IDE or a switch would,
+// and measures how long the nodes take to reply.
+//
+// Connects to one or more ports (one client per network, as the plugin accepts only one),
+// discovers the nodes and then, for each node, sends user events, polls ranges of variables
+// with `GET_VARIABLES` and uploads bytecode, each at its own rate. Replies are matched
+// in order with the requests to compute latencies:
+// - polls are answered by `VARIABLES`;
+// - uploads (`SET_BYTECODE`, `RESET`, `RUN`) are followed by `GET_EXECUTION_STATE`:
+//   as `RESET` and `RUN` are answered by `EXECUTION_STATE_CHANGED` too, an upload is
+//   complete at the third `EXECUTION_STATE_CHANGED`;
+// - events are answered only if the script of the node emits `--reply-event` for each one.
+//
+// Uploads replace the scripts of the nodes: by default with an empty program.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/consts.h"
+#include "dashel/dashel.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// log2 buckets of latencies [us], the last one is unbounded
+static const size_t HISTOGRAM_BUCKETS = 24;
+// words of bytecode per SET_BYTECODE message
+static const size_t BYTECODE_CHUNK = 128;
+// `EXECUTION_STATE_CHANGED` sent by the VM for `RESET`, `RUN` and `GET_EXECUTION_STATE`
+static const unsigned UPLOAD_REPLIES = 3;
+
+static void show_usage(std::string name) {
+  std::cout << "Usage: " << name << " <option(s)>" << std::endl
+            << "Options:" << std::endl
+            << "  --help\t\t\tShow this help message" << std::endl
+            << "  --host=<HOST>\t\tHost of the networks (default: 127.0.0.1)" << std::endl
+            << "  --port=<PORT>\t\tFirst port (default: 33333)" << std::endl
+            << "  --ports=<M>\t\tNumber of consecutive ports (default: 1)" << std::endl
+            << "  --discovery=<S>\tTime to discover the nodes [s] (default: 1)" << std::endl
+            << "  --event-rate=<HZ>\tUser events per node and second (default: 0)" << std::endl
+            << "  --event=<ID>\t\tUser event to send (default: 0)" << std::endl
+            << "  --event-args=<N>\tArguments of the event (default: 0)" << std::endl
+            << "  --reply-event=<ID>\tUser event answering each event (default: none)"
+            << std::endl
+            << "  --poll-rate=<HZ>\tPolls per node, range and second (default: 0)" << std::endl
+            << "  --poll=<START>:<LENGTH>\tRange of variables to poll, can be repeated "
+               "(default: 0:1)"
+            << std::endl
+            << "  --upload-rate=<HZ>\tBytecode uploads per node and second (default: 0)"
+            << std::endl
+            << "  --bytecode=<PATH>\tWords to upload, as integers (default: empty program)"
+            << std::endl
+            << "  --duration=<S>\tDuration of the measure [s] (default: 10)" << std::endl
+            << "  --format=<F>\t\tjson or csv (default: json)" << std::endl
+            << "  --output=<PATH>\tWrite the results to a file (default: stdout)" << std::endl;
+}
+
+// Messages are (payload size, source, type, payload...), in little-endian words
+static void write_message(Dashel::Stream * stream, uint16_t type,
+                          const std::vector<uint16_t> & payload) {
+  std::vector<uint8_t> buffer(6 + 2 * payload.size());
+  auto put = [&buffer](size_t index, uint16_t value) {
+    buffer[2 * index] = value & 0xff;
+    buffer[2 * index + 1] = value >> 8;
+  };
+  put(0, 2 * payload.size());
+  put(1, 0);
+  put(2, type);
+  for (size_t i = 0; i < payload.size(); i++) put(3 + i, payload[i]);
+  stream->write(buffer.data(), buffer.size());
+}
+
+struct Latencies {
+  // [us]
+  std::vector<double> samples;
+  uint64_t sent = 0;
+  uint64_t lost = 0;
+
+  void add(double value) { samples.push_back(value); }
+
+  std::vector<uint64_t> histogram() const {
+    std::vector<uint64_t> counts(HISTOGRAM_BUCKETS, 0);
+    for (double value : samples) {
+      size_t bucket = value < 1.0 ? 0 : size_t(std::log2(value)) + 1;
+      counts[std::min(bucket, HISTOGRAM_BUCKETS - 1)]++;
+    }
+    return counts;
+  }
+};
+
+// Sends at a given rate, without bursts after a stall longer than a second
+class Schedule {
+ public:
+  explicit Schedule(double rate) : period(rate > 0 ? 1.0 / rate : 0.0), next(Clock::now()) {}
+
+  bool due(Clock::time_point now) {
+    if (period <= 0 || now < next) return false;
+    next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period));
+    if (now - next > std::chrono::seconds(1)) next = now;
+    return true;
+  }
+
+ private:
+  double period;
+  Clock::time_point next;
+};
+
+struct Options {
+  double event_rate = 0.0;
+  uint16_t event = 0;
+  unsigned event_args = 0;
+  int reply_event = -1;
+  double poll_rate = 0.0;
+  std::vector<std::pair<uint16_t, uint16_t>> polls;
+  double upload_rate = 0.0;
+  std::vector<uint16_t> bytecode;
+};
+
+class LoadGenerator : public Dashel::Hub {
+ public:
+  std::map<std::string, Latencies> latencies;
+  uint64_t messages_in = 0;
+  uint64_t messages_out = 0;
+  unsigned closed = 0;
+
+  explicit LoadGenerator(const Options & options) : options(options) {
+    latencies["event"];
+    latencies["poll"];
+    latencies["upload"];
+  }
+
+  void discover() {
+    for (Dashel::Stream * stream : streams) {
+      write_message(stream, ASEBA_MESSAGE_GET_DESCRIPTION, {});
+    }
+    flush_all();
+  }
+
+  void start() {
+    for (auto & [key, node] : nodes) {
+      node.events = Schedule(options.event_rate);
+      node.polls.assign(options.polls.size(), Schedule(options.poll_rate));
+      node.upload = Schedule(options.upload_rate);
+    }
+    measuring = true;
+  }
+
+  void stop() {
+    measuring = false;
+    for (auto & [key, node] : nodes) {
+      latencies["event"].lost += node.pending_events.size();
+      latencies["poll"].lost += node.pending_polls.size();
+      latencies["upload"].lost += node.pending_uploads.size();
+    }
+  }
+
+  size_t number_of_nodes() const { return nodes.size(); }
+
+  void add_network(const std::string & target) {
+    streams.push_back(connect(target));
+  }
+
+  // Sends what is due
+  void send() {
+    if (!measuring) return;
+    const auto now = Clock::now();
+    for (auto & [key, node] : nodes) {
+      const uint16_t uid = key.second;
+      if (node.events.due(now)) {
+        std::vector<uint16_t> args(options.event_args, 0);
+        if (!args.empty()) args[0] = uid;
+        write_message(node.stream, options.event, args);
+        latencies["event"].sent++;
+        messages_out++;
+        if (options.reply_event >= 0) node.pending_events.push_back(now);
+      }
+      for (size_t i = 0; i < node.polls.size(); i++) {
+        if (!node.polls[i].due(now)) continue;
+        const auto & [start, length] = options.polls[i];
+        write_message(node.stream, ASEBA_MESSAGE_GET_VARIABLES, {uid, start, length});
+        latencies["poll"].sent++;
+        messages_out++;
+        node.pending_polls.push_back({start, now});
+      }
+      if (node.upload.due(now)) {
+        upload(node.stream, uid);
+        latencies["upload"].sent++;
+        node.pending_uploads.push_back({now, UPLOAD_REPLIES});
+      }
+    }
+    flush_all();
+  }
+
+ protected:
+  void incomingData(Dashel::Stream * stream) override {
+    uint8_t header[6];
+    stream->read(header, 6);
+    auto get = [](const uint8_t * data) { return uint16_t(data[0] | (data[1] << 8)); };
+    const uint16_t size = get(header);
+    const uint16_t source = get(header + 2);
+    const uint16_t type = get(header + 4);
+    std::vector<uint8_t> payload(size);
+    if (size) stream->read(payload.data(), size);
+    const auto now = Clock::now();
+    messages_in++;
+    const auto key = std::make_pair(stream, source);
+    if (!nodes.count(key)) {
+      // any message from a node during the discovery
+      if (!measuring && source) nodes[key].stream = stream;
+      return;
+    }
+    if (!measuring) return;
+    Node & node = nodes.at(key);
+    auto elapsed = [now](Clock::time_point start) {
+      return std::chrono::duration<double, std::micro>(now - start).count();
+    };
+    if (type == ASEBA_MESSAGE_VARIABLES && size >= 2) {
+      const uint16_t start = get(payload.data());
+      // replies come in order: skip the polls that were not answered
+      while (!node.pending_polls.empty()) {
+        const auto [pending_start, sent_at] = node.pending_polls.front();
+        node.pending_polls.pop_front();
+        if (pending_start == start) {
+          latencies["poll"].add(elapsed(sent_at));
+          break;
+        }
+        latencies["poll"].lost++;
+      }
+    } else if (type == ASEBA_MESSAGE_EXECUTION_STATE_CHANGED) {
+      if (!node.pending_uploads.empty()) {
+        auto & [sent_at, replies] = node.pending_uploads.front();
+        if (--replies == 0) {
+          latencies["upload"].add(elapsed(sent_at));
+          node.pending_uploads.pop_front();
+        }
+      }
+    } else if (options.reply_event >= 0 && type == options.reply_event) {
+      if (!node.pending_events.empty()) {
+        latencies["event"].add(elapsed(node.pending_events.front()));
+        node.pending_events.pop_front();
+      }
+    }
+  }
+
+  void connectionClosed(Dashel::Stream * stream, bool abnormal) override {
+    // e.g., when the network is already serving another client
+    std::cerr << "Connection to " << stream->getTargetName() << " closed" << std::endl;
+    closed++;
+    for (auto it = nodes.begin(); it != nodes.end();) {
+      it = it->first.first == stream ? nodes.erase(it) : std::next(it);
+    }
+    streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+  }
+
+ private:
+  struct Node {
+    Dashel::Stream * stream = nullptr;
+    Schedule events{0.0};
+    std::vector<Schedule> polls;
+    Schedule upload{0.0};
+    std::deque<Clock::time_point> pending_events;
+    std::deque<std::pair<uint16_t, Clock::time_point>> pending_polls;
+    // (sent at, replies still expected)
+    std::deque<std::pair<Clock::time_point, unsigned>> pending_uploads;
+  };
+  // by (stream, node id), as node ids are only unique within a network
+  std::map<std::pair<Dashel::Stream *, uint16_t>, Node> nodes;
+  std::vector<Dashel::Stream *> streams;
+  const Options & options;
+  bool measuring = false;
+
+  // as the IDE does when it loads a script
+  void upload(Dashel::Stream * stream, uint16_t uid) {
+    const auto & bytecode = options.bytecode;
+    for (size_t start = 0; start < bytecode.size(); start += BYTECODE_CHUNK) {
+      std::vector<uint16_t> payload{uid, uint16_t(start)};
+      const size_t end = std::min(bytecode.size(), start + BYTECODE_CHUNK);
+      payload.insert(payload.end(), bytecode.begin() + start, bytecode.begin() + end);
+      write_message(stream, ASEBA_MESSAGE_SET_BYTECODE, payload);
+      messages_out++;
+    }
+    write_message(stream, ASEBA_MESSAGE_RESET, {uid});
+    write_message(stream, ASEBA_MESSAGE_RUN, {uid});
+    write_message(stream, ASEBA_MESSAGE_GET_EXECUTION_STATE, {uid});
+    messages_out += 3;
+  }
+
+  void flush_all() {
+    for (Dashel::Stream * stream : streams) stream->flush();
+  }
+};
+
+static bool read_bytecode(const std::string & path, std::vector<uint16_t> & bytecode) {
+  std::ifstream file(path);
+  if (!file) return false;
+  bytecode.clear();
+  int word;
+  while (file >> word) bytecode.push_back(uint16_t(word));
+  return !bytecode.empty();
+}
+
+static double percentile(const std::vector<double> & sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+int main(int argc, char **argv) {
+  char host[128] = "127.0.0.1";
+  unsigned first_port = ASEBA_DEFAULT_PORT;
+  unsigned number_of_ports = 1;
+  double discovery = 1.0;
+  double duration = 10.0;
+  char format[8] = "json";
+  char output[256] = "";
+  char path[256] = "";
+  Options options;
+  // an empty event vector table followed by `stop`
+  options.bytecode = {1, 0};
+  for (int i = 1; i < argc; i++) {
+    unsigned value, start, length;
+    int reply;
+    if (sscanf(argv[i], "--host=%127s", host)) continue;
+    if (sscanf(argv[i], "--port=%u", &first_port)) continue;
+    if (sscanf(argv[i], "--ports=%u", &number_of_ports)) continue;
+    if (sscanf(argv[i], "--discovery=%lf", &discovery)) continue;
+    if (sscanf(argv[i], "--event-rate=%lf", &options.event_rate)) continue;
+    if (sscanf(argv[i], "--event=%u", &value)) {
+      options.event = value;
+      continue;
+    }
+    if (sscanf(argv[i], "--event-args=%u", &options.event_args)) continue;
+    if (sscanf(argv[i], "--reply-event=%d", &reply)) {
+      options.reply_event = reply;
+      continue;
+    }
+    if (sscanf(argv[i], "--poll-rate=%lf", &options.poll_rate)) continue;
+    if (sscanf(argv[i], "--poll=%u:%u", &start, &length) == 2) {
+      options.polls.push_back({uint16_t(start), uint16_t(length)});
+      continue;
+    }
+    if (sscanf(argv[i], "--upload-rate=%lf", &options.upload_rate)) continue;
+    if (sscanf(argv[i], "--bytecode=%255s", path)) continue;
+    if (sscanf(argv[i], "--duration=%lf", &duration)) continue;
+    if (sscanf(argv[i], "--format=%7s", format)) continue;
+    if (sscanf(argv[i], "--output=%255s", output)) continue;
+    show_usage(argv[0]);
+    return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+  }
+  if (options.polls.empty()) options.polls.push_back({0, 1});
+  options.event_args = std::min(options.event_args, unsigned(ASEBA_MAX_EVENT_ARG_SIZE / 2));
+  if (path[0] && !read_bytecode(path, options.bytecode)) {
+    std::cerr << "Failed to read the bytecode from " << path << std::endl;
+    return 1;
+  }
+
+  LoadGenerator generator(options);
+  try {
+    for (unsigned i = 0; i < std::max(number_of_ports, 1u); i++) {
+      generator.add_network("tcp:host=" + std::string(host) +
+                            ";port=" + std::to_string(first_port + i));
+    }
+  } catch (Dashel::DashelException & e) {
+    std::cerr << "Failed to connect: " << e.what() << std::endl;
+    return 1;
+  }
+
+  generator.discover();
+  auto start = Clock::now();
+  while (std::chrono::duration<double>(Clock::now() - start).count() < discovery) {
+    generator.step(10);
+  }
+  if (!generator.number_of_nodes()) {
+    std::cerr << "No nodes found" << std::endl;
+    return 1;
+  }
+
+  generator.start();
+  start = Clock::now();
+  while (generator.number_of_nodes() &&
+         std::chrono::duration<double>(Clock::now() - start).count() < duration) {
+    generator.send();
+    generator.step(1);
+  }
+  const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  // wait a bit for the last replies
+  const auto end = Clock::now();
+  while (std::chrono::duration<double>(Clock::now() - end).count() < 0.5) generator.step(10);
+  generator.stop();
+
+  std::ofstream file;
+  if (output[0]) file.open(output);
+  std::ostream & out = output[0] ? file : std::cout;
+  if (strcmp(format, "csv") == 0) {
+    out << "kind,nodes,duration,sent,received,lost,latency_p50_us,latency_p90_us,"
+           "latency_p99_us,latency_max_us";
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) out << ",bucket_" << i;
+    out << std::endl;
+  } else {
+    out << "{\"nodes\": " << generator.number_of_nodes() << ", \"duration\": " << elapsed
+        << ", \"messages_out\": " << generator.messages_out
+        << ", \"messages_in\": " << generator.messages_in
+        << ", \"closed_connections\": " << generator.closed
+        << ",\n \"histogram_bounds_us\": [";
+    for (size_t i = 0; i + 1 < HISTOGRAM_BUCKETS; i++) out << (i ? ", " : "") << (1u << i);
+    out << "]";
+  }
+  for (auto & [kind, l] : generator.latencies) {
+    std::sort(l.samples.begin(), l.samples.end());
+    const double max = l.samples.empty() ? 0.0 : l.samples.back();
+    const auto histogram = l.histogram();
+    if (strcmp(format, "csv") == 0) {
+      out << kind << "," << generator.number_of_nodes() << "," << elapsed << "," << l.sent << ","
+          << l.samples.size() << "," << l.lost << "," << percentile(l.samples, 0.5) << ","
+          << percentile(l.samples, 0.9) << "," << percentile(l.samples, 0.99) << "," << max;
+      for (auto count : histogram) out << "," << count;
+      out << std::endl;
+    } else {
+      out << ",\n \"" << kind << "\": {\"sent\": " << l.sent
+          << ", \"received\": " << l.samples.size() << ", \"lost\": " << l.lost
+          << ", \"latency_us\": {\"p50\": " << percentile(l.samples, 0.5)
+          << ", \"p90\": " << percentile(l.samples, 0.9)
+          << ", \"p99\": " << percentile(l.samples, 0.99) << ", \"max\": " << max
+          << "}, \"histogram\": [";
+      for (size_t i = 0; i < histogram.size(); i++) out << (i ? ", " : "") << histogram[i];
+      out << "]}";
+    }
+  }
+  if (strcmp(format, "csv") != 0) out << "}" << std::endl;
+  return 0;
+}
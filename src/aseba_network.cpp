@@ -2,34 +2,253 @@
 TODO: preamble
 */
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <stack>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <thread>
 
 #include "aseba_network.h"
 #include "common/zeroconf/zeroconf-dashelhub.h"
 #include "dashel/dashel.h"
 #include "logging.h"
+#include "outbound_queue.h"
+#include "profiler.h"
+#include "spsc_queue.h"
+#include "tracer.h"
 
 #ifdef EXTERNAL_ADVERTISE
 #include <simPlusPlus/Lib.h>
 #endif
 
+class AsebaDashel;
+
+// An event of the client of a network, handled by the simulation thread
+struct AsebaInbound {
+  // DROPPED: the client was disconnected, as it sent too many messages
+  enum Kind { DATA, CONNECTED, DISCONNECTED, DROPPED };
+  Kind kind;
+  // of the network
+  int port;
+  Dashel::Stream *stream;
+  uint16_t source;
+  // type and payload
+  std::valarray<uint8_t> data;
+  // of the client, for CONNECTED (see `AsebaDashel::connection`)
+  unsigned connection = 0;
+};
+
+// A message to the client of a network
+struct AsebaOutbound {
+  int port;
+  // the client it is for, dropped if another client has connected meanwhile
+  unsigned connection;
+  // size, source, type and payload
+  std::vector<uint8_t> frame;
+};
+
+// [ms] the I/O thread waits at most this long before writing queued messages
+static const int IO_TIMEOUT = 1;
+
+// The hub of the streams of all networks, so that spinning waits once for all of them
+// instead of once per network. Events are forwarded to the network owning the stream.
+//
+// The hub is used either by the simulation thread, which steps it in `Aseba::spin`,
+// or by an I/O thread (see `Aseba::configure_io_thread`). In the second case,
+// the threads exchange messages through queues: the I/O thread pushes the events of clients
+// to `inbound`, which the simulation thread drains at each step, and the simulation thread
+// pushes messages to `outbound` without waiting for them to be written.
+class AsebaHub : public Dashel::Hub {
+public:
+  // port -> network listening on it
+  std::map<int, AsebaDashel *> listeners;
+  // client stream -> network
+  std::map<Dashel::Stream *, AsebaDashel *> clients;
+#ifdef ZEROCONF
+  Aseba::DashelhubZeroconf zeroconf;
+#endif
+  // whether the I/O thread is running
+  std::atomic<bool> running{false};
+
+  AsebaHub()
+#ifdef ZEROCONF
+      : zeroconf(*this)
+#endif
+  {
+  }
+
+  ~AsebaHub() { stop_thread(); }
+
+  // To hold by the simulation thread while using the hub
+  std::unique_lock<std::mutex> guard() {
+    if (!running)
+      return std::unique_lock<std::mutex>();
+    return std::unique_lock<std::mutex>(mutex);
+  }
+
+  void start_thread(size_t capacity) {
+    stop_thread();
+    inbound = std::make_unique<SPSCQueue<AsebaInbound>>(capacity);
+    outbound = std::make_unique<SPSCQueue<AsebaOutbound>>(capacity);
+    running = true;
+    thread = std::thread(&AsebaHub::io_loop, this);
+    log_info("Started the network I/O thread with queues of %zu messages",
+             inbound->capacity());
+  }
+
+  void stop_thread() {
+    if (!running)
+      return;
+    stopping = true;
+    thread.join();
+    stopping = false;
+    // the simulation thread owns the hub again
+    running = false;
+    drain();
+    for (auto &event : overflow) {
+      dispatch(event);
+    }
+    overflow.clear();
+    overflow_depth.clear();
+    close_streams();
+    write_outbound();
+    for (auto &message : spilled) {
+      queue_for_client(message);
+    }
+    spilled.clear();
+    write_outbound();
+    log_info("Stopped the network I/O thread");
+  }
+
+  // Handles the events queued by the I/O thread. Called by the simulation thread.
+  void drain() {
+    if (!inbound)
+      return;
+    AsebaInbound event;
+    while (inbound->pop(event)) {
+      dispatch(event);
+    }
+  }
+
+  // Queues a message for the I/O thread. Returns false if the queue is full
+  // and the message was dropped, else the message is kept until there is room.
+  // Called by the simulation thread.
+  bool send(int port, unsigned connection, std::vector<uint8_t> &&frame, bool droppable) {
+    AsebaOutbound message{port, connection, std::move(frame)};
+    // keep the order of the messages
+    if (spilled.empty() && outbound->push(std::move(message)))
+      return true;
+    if (droppable)
+      return false;
+    spilled.push_back(std::move(message));
+    return true;
+  }
+
+  // Queues the messages that did not fit at previous steps. Called by the simulation thread.
+  void retry_spilled() {
+    while (!spilled.empty() && outbound->push(std::move(spilled.front()))) {
+      spilled.pop_front();
+    }
+  }
+
+  // Closes a client stream. The I/O thread may be writing to it without holding the lock,
+  // so then it closes the stream itself, once done.
+  void close_client(Dashel::Stream *stream) {
+    if (running) {
+      closing.insert(stream);
+    } else {
+      closeStream(stream);
+    }
+  }
+
+  void forget(AsebaDashel *network) {
+    for (auto it = listeners.begin(); it != listeners.end();) {
+      it = it->second == network ? listeners.erase(it) : std::next(it);
+    }
+    for (auto it = clients.begin(); it != clients.end();) {
+      it = it->second == network ? clients.erase(it) : std::next(it);
+    }
+  }
+
+  // NOTE(Jerome): not profiled here, as the profiler is only used by the simulation thread
+  bool step_streams(int timeout = 0) {
+#ifdef ZEROCONF
+    return zeroconf.dashelStep(timeout);
+#else
+    return step(timeout);
+#endif // ZEROCONF
+  }
+
+protected:
+  void connectionCreated(Dashel::Stream *stream) override;
+  void incomingData(Dashel::Stream *stream) override;
+  void connectionClosed(Dashel::Stream *stream, bool abnormal) override;
 
-class AsebaDashel : public Dashel::Hub {
+private:
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+  // held by the I/O thread while it uses the hub
+  std::mutex mutex;
+  std::unique_ptr<SPSCQueue<AsebaInbound>> inbound;
+  std::unique_ptr<SPSCQueue<AsebaOutbound>> outbound;
+  // events that did not fit in `inbound`, e.g., while the simulation is paused,
+  // for each client at most as many messages as `inbound` can hold.
+  // Only used by the I/O thread.
+  std::deque<AsebaInbound> overflow;
+  // client -> messages in `overflow`
+  std::map<Dashel::Stream *, size_t> overflow_depth;
+  // messages that did not fit in `outbound` and cannot be dropped.
+  // Only used by the simulation thread.
+  std::deque<AsebaOutbound> spilled;
+  // client streams to close (see `close_client`), used while holding the lock
+  std::set<Dashel::Stream *> closing;
+  // (client, messages) to write without holding the lock, as writing may block.
+  // Only used by the I/O thread.
+  std::vector<std::pair<Dashel::Stream *, std::vector<std::vector<uint8_t>>>> blocking;
+
+  void io_loop();
+  void queue_for_client(AsebaOutbound &message);
+  void deliver(AsebaInbound &&event);
+  bool is_in_overflow(const AsebaInbound &event) const;
+  void dispatch(AsebaInbound &event);
+
+public:
+  void close_streams();
+  // Writes the messages queued for the clients. Called by the thread using the hub.
+  // If `defer_blocking`, the messages that may block are moved to `blocking` instead.
+  void write_outbound(bool defer_blocking = false);
+};
+
+static AsebaHub &shared_hub() {
+  static AsebaHub hub;
+  return hub;
+}
+
+class AsebaDashel {
 private:
   inline static std::string address = "0.0.0.0";
   inline static bool advertise_enabled = true;
   inline static bool advertise_external = false;
+  inline static OutboundQueue::Policy outbound_policy = OutboundQueue::BLOCK;
+  inline static size_t outbound_capacity = 256;
 
 public:
   static void set_address(const std::string &a) { address = a; }
 
+  static void configure_outbound(OutboundQueue::Policy policy, size_t capacity) {
+    outbound_policy = policy;
+    outbound_capacity = capacity;
+  }
+
   static void configure_advertisement(bool enabled, bool external) {
     advertise_enabled = enabled;
     advertise_external = external;
@@ -38,7 +257,7 @@ public:
 private:
   // stream for listening to incoming connections
   Dashel::Stream *listenStream;
-  int timeout;
+  AsebaHub &hub;
   int port;
   int next_id;
   std::set<Dashel::Stream *> toDisconnect;
@@ -46,19 +265,23 @@ private:
 
 public:
   std::map<int, DynamicAsebaNode *> nodes;
-  // this must be public because of bindings to C functions
-  Dashel::Stream *stream;
-#ifdef ZEROCONF
-  Aseba::DashelhubZeroconf zeroconf;
-#endif
+  AsebaNetworkStats stats;
+  // by the I/O thread, while the simulation did not handle the messages of the client
+  std::atomic<uint64_t> requests_dropped{0};
+  // the messages to the client, used by the thread using the hub
+  OutboundQueue outbound;
+  // this must be public because of bindings to C functions.
+  // Atomic as the I/O thread may change it while the simulation thread sends messages.
+  std::atomic<Dashel::Stream *> stream;
+  // the number of clients accepted, i.e., the current one, used by the thread using the hub
+  unsigned connection = 0;
+  // the same, for the simulation thread: updated when it handles the connection
+  unsigned simulation_connection = 0;
   // all streams that must be disconnected at next step
-  explicit AsebaDashel(const int port = ASEBA_DEFAULT_PORT, int timeout = 0)
-      : port(port), timeout(timeout), stream(NULL), next_id(0)
-#ifdef ZEROCONF
-        ,
-        zeroconf(*this)
-#endif
-  {
+  explicit AsebaDashel(const int port = ASEBA_DEFAULT_PORT)
+      : hub(shared_hub()), port(port), stream(NULL), next_id(0) {
+    outbound.policy = outbound_policy;
+    outbound.capacity = outbound_capacity;
     // advertised_target = std::string("Not A Thymio 3: CoppeliaSim ") +
     // std::to_string(port);
     advertised_target = std::string("CoppeliaSim ") + std::to_string(port);
@@ -71,6 +294,26 @@ public:
     for (auto kv : nodes) {
       delete kv.second;
     }
+#ifdef ZEROCONF
+    // the zeroconf of the hub outlives the network
+    if (advertise_enabled && !advertise_external) {
+      try {
+        deadvertise();
+      } catch (const std::runtime_error &e) {
+        log_warn("Could not deadvertise: %s", e.what());
+      }
+    }
+#endif
+    hub.forget(this);
+    // the hub would only close them when destroyed
+    if (Dashel::Stream *s = stream) {
+      hub.close_client(s);
+    }
+    toDisconnect.insert(listenStream);
+    toDisconnect.erase(nullptr);
+    for (auto s : toDisconnect) {
+      hub.closeStream(s);
+    }
     log_info("Deleted network on tcp:port=%d", port);
   }
 
@@ -154,7 +397,7 @@ public:
     // Aseba::Zeroconf::TxtRecord txt{protocolVersion, names, false, ids, pids};
     Aseba::Zeroconf::TxtRecord txt{protocolVersion, name, false, ids, pids};
     try {
-      zeroconf.advertise(advertised_target, listenStream, txt);
+      hub.zeroconf.advertise(advertised_target, listenStream, txt);
       log_debug("Advertise Aseba network %s with %s", advertised_target.c_str(),
                 txt.record().c_str());
     } catch (const std::runtime_error &e) {
@@ -166,16 +409,21 @@ public:
     if (!listenStream)
       return;
     log_debug("Deadvertise Aseba Network");
-    zeroconf.forget(advertised_target, listenStream);
+    hub.zeroconf.forget(advertised_target, listenStream);
   }
 #endif
 
+  int get_port() const { return port; }
+
   Dashel::Stream *listen() {
     // connect network
     try {
       std::ostringstream oss;
       oss << "tcpin:port=" << port << ";address=" << address;
-      listenStream = Dashel::Hub::connect(oss.str());
+      listenStream = hub.connect(oss.str());
+      // the actual port, if it was chosen by the system
+      port = std::stoi(listenStream->getTargetParameter("port"));
+      hub.listeners[port] = this;
     } catch (Dashel::DashelException e) {
       log_warn("Cannot create listening port %d: %s", port, e.what());
       listenStream = nullptr;
@@ -183,14 +431,18 @@ public:
     return listenStream;
   }
 
-  virtual void connectionCreated(Dashel::Stream *stream) {
+  // Returns whether the stream became the client of the network
+  bool connectionCreated(Dashel::Stream *stream) {
     std::string targetName = stream->getTargetName();
     log_info("Incoming Dashel connection from %s", targetName.c_str());
     if (targetName.substr(0, targetName.find_first_of(':')) == "tcp") {
       // schedule current stream for disconnection
       if (!this->stream) {
         this->stream = stream;
+        connection++;
+        outbound.clear();
         log_info("Connection accepted");
+        return true;
       } else {
         log_info(
             "Connection refused: we are already connected to a client stream");
@@ -204,6 +456,7 @@ public:
       // this->stream = stream;
       // printf("New client connected.\n");
     }
+    return false;
   }
 #if 0
   virtual void connectionCreated(Dashel::Stream *stream) {
@@ -219,58 +472,62 @@ public:
     }
   }
 #endif
-  virtual void connectionClosed(Dashel::Stream *stream, bool abnormal) {
+  // Returns whether the stream was the client of the network
+  bool connectionClosed(Dashel::Stream *stream, bool abnormal) {
     log_info("Dashel connection closed");
-#ifdef ZEROCONF_SUPPORT
-    zeroconf.dashelConnectionClosed(stream);
-#endif // ZEROCONF_SUPPORT
-    if (stream == this->stream) {
+    const bool was_client = stream == this->stream;
+    if (was_client) {
       this->stream = nullptr;
-      // clear breakpoints
-      for (auto kv : nodes) {
-        (kv.second)->vm.breakpointsCount = 0;
-      }
+      outbound.clear();
     }
     toDisconnect.erase(stream);
     if (abnormal)
       log_warn("Client has disconnected unexpectedly.");
     // else
     // printf("Client has disconnected properly.\n");
+    return was_client;
   }
 
-  virtual void incomingData(Dashel::Stream *stream) {
-#ifdef ZEROCONF_SUPPORT
-    if (zeroconf.isStreamHandled(stream)) {
-      log_debug("Incoming data for zeroconf");
-      try {
-        zeroconf.dashelIncomingData(stream);
-      } catch (const std::exception &e) {
-        log_error("Advertise: %s", e.what());
-      }
-      return;
+  void write_outbound() {
+    Dashel::Stream *s = stream;
+    if (s) {
+      outbound.write(s);
     }
-#endif // ZEROCONF_SUPPORT
+  }
+
+  // Disconnects `stream` if it is the client. Called by the thread using the hub.
+  bool drop_client(Dashel::Stream *stream) {
+    if (!stream || stream != this->stream)
+      return false;
+    this->stream = nullptr;
+    outbound.clear();
+    toDisconnect.insert(stream);
+    return true;
+  }
 
+  void clear_breakpoints() {
+    for (auto kv : nodes) {
+      (kv.second)->vm.breakpointsCount = 0;
+    }
+  }
+
+  // Processes a message read by the hub
+  void receive(Dashel::Stream *stream, uint16_t lastMessageSource,
+               const std::valarray<uint8_t> &lastMessageData) {
     // only process data for the current stream
     if (stream != this->stream) {
       // printf("[DASHEL] incomingData from %p (%p) -> ignore\n", stream,
       // this->stream);
       return;
     }
-    uint16_t temp;
-    uint16_t len;
-    stream->read(&temp, 2);
-    len = bswap16(temp);
-    stream->read(&temp, 2);
-    uint16_t lastMessageSource;
-    std::valarray<uint8_t> lastMessageData;
-    lastMessageSource = bswap16(temp);
-    lastMessageData.resize(len + 2);
-    stream->read(&lastMessageData[0], lastMessageData.size());
+    const uint16_t len = lastMessageData.size() - 2;
     // uint16_t type = bswap16(lastMessageData[0]);
     uint16_t type;
     memcpy(&type, &lastMessageData[0], 2);
     type = bswap16(type);
+    TRACE_SCOPE("receive", lastMessageSource, type);
+    stats.messages_in++;
+    stats.bytes_in += len + 6;
     // memcpy(data, &node->lastMessageData[0], node->lastMessageData.size());
 
     // printf("[DASHEL] incomingData %d %d => %d\n", lastMessageData[0],
@@ -296,7 +553,7 @@ public:
           node->lastMessageSource = lastMessageSource;
           node->lastMessageData = lastMessageData;
           AsebaProcessIncomingEvents(&(node->vm));
-          AsebaVMRun(&(node->vm), 1000);
+          node->run();
         }
       }
       return;
@@ -308,35 +565,31 @@ public:
         node->lastMessageSource = lastMessageSource;
         node->lastMessageData = lastMessageData;
         AsebaProcessIncomingEvents(&(node->vm));
-        AsebaVMRun(&(node->vm), 1000);
+        node->run();
       }
     }
   }
 
-  bool spin(float dt) {
-#ifdef ZEROCONF
-    if (!zeroconf.dashelStep(timeout))
-#else
-    if (!step(timeout))
-#endif // ZEROCONF
-      return false;
-
+  // after the hub has stepped
+  void spin(float dt) {
     for (const auto kv : nodes) {
       auto node = kv.second;
-      // if (node->finalized)
-      //   node->step(dt);
-      node->finalized = true;
+      if (!node->finalized)
+        node->finalize();
       node->step(dt);
     }
-    // disconnect old streams
-    lock();
+  }
+
+  // Disconnects old streams. Called by the thread using the hub.
+  void close_streams() {
+    hub.lock();
     for (auto stream : toDisconnect) {
-      closeStream(stream);
+      hub.clients.erase(stream);
+      hub.closeStream(stream);
       log_info("Stream closed in spin");
     }
     toDisconnect.clear();
-    unlock();
-    return true;
+    hub.unlock();
   }
   //
   // void run() {
@@ -344,6 +597,260 @@ public:
   // }
 };
 
+void AsebaHub::connectionCreated(Dashel::Stream *stream) {
+  const std::string targetName = stream->getTargetName();
+  if (targetName.substr(0, targetName.find_first_of(':')) != "tcp")
+    return;
+  // Dashel tells on which port the connection was accepted
+  const std::string port = stream->getTargetParameter("connectionPort");
+  const auto it = port.empty() ? listeners.end() : listeners.find(std::stoi(port));
+  if (it == listeners.end()) {
+    log_warn("No network for incoming connection %s", targetName.c_str());
+    return;
+  }
+  clients[stream] = it->second;
+  if (it->second->connectionCreated(stream)) {
+    deliver({AsebaInbound::CONNECTED, it->first, stream, 0, {}, it->second->connection});
+  }
+}
+
+void AsebaHub::incomingData(Dashel::Stream *stream) {
+#ifdef ZEROCONF_SUPPORT
+  if (zeroconf.isStreamHandled(stream)) {
+    log_debug("Incoming data for zeroconf");
+    try {
+      zeroconf.dashelIncomingData(stream);
+    } catch (const std::exception &e) {
+      log_error("Advertise: %s", e.what());
+    }
+    return;
+  }
+#endif // ZEROCONF_SUPPORT
+  const auto it = clients.find(stream);
+  // only read data for the current stream
+  if (it == clients.end() || it->second->stream != stream) {
+    return;
+  }
+  uint16_t temp;
+  stream->read(&temp, 2);
+  const uint16_t len = bswap16(temp);
+  stream->read(&temp, 2);
+  const uint16_t source = bswap16(temp);
+  std::valarray<uint8_t> data(len + 2);
+  stream->read(&data[0], data.size());
+  deliver({AsebaInbound::DATA, it->second->get_port(), stream, source, std::move(data)});
+}
+
+void AsebaHub::connectionClosed(Dashel::Stream *stream, bool abnormal) {
+#ifdef ZEROCONF_SUPPORT
+  zeroconf.dashelConnectionClosed(stream);
+#endif // ZEROCONF_SUPPORT
+  // Dashel deletes it
+  closing.erase(stream);
+  const auto it = clients.find(stream);
+  if (it != clients.end()) {
+    AsebaDashel *network = it->second;
+    clients.erase(it);
+    if (network->connectionClosed(stream, abnormal)) {
+      deliver({AsebaInbound::DISCONNECTED, network->get_port(), stream, 0, {}});
+    }
+  }
+}
+
+void AsebaHub::io_loop() {
+  while (!stopping) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      step_streams(IO_TIMEOUT);
+      close_streams();
+      // after closing, so that the streams stay valid until written
+      write_outbound(true);
+    }
+    for (const auto &[stream, frames] : blocking) {
+      OutboundQueue::write_all(stream, frames);
+    }
+    blocking.clear();
+    while (!overflow.empty()) {
+      const bool data = overflow.front().kind == AsebaInbound::DATA;
+      Dashel::Stream *stream = overflow.front().stream;
+      if (!inbound->push(std::move(overflow.front())))
+        break;
+      overflow.pop_front();
+      if (data && !--overflow_depth[stream])
+        overflow_depth.erase(stream);
+    }
+    // let the simulation thread take the lock, if it is waiting for it
+    std::this_thread::yield();
+  }
+}
+
+void AsebaHub::deliver(AsebaInbound &&event) {
+  if (!running) {
+    dispatch(event);
+    return;
+  }
+  // keep the order of the events
+  if (overflow.empty() && inbound->push(std::move(event)))
+    return;
+  if (overflow.empty()) {
+    log_warn("Network events are queued faster than the simulation handles them");
+  }
+  if (event.kind == AsebaInbound::DATA) {
+    const auto it = listeners.find(event.port);
+    AsebaDashel *network = it == listeners.end() ? nullptr : it->second;
+    const bool full = overflow_depth[event.stream] >= inbound->capacity();
+    uint16_t type;
+    memcpy(&type, &event.data[0], 2);
+    type = bswap16(type);
+    // requests that can be dropped or that are repeated, e.g., by an IDE polling variables
+    if (type < 0x8000 || type == ASEBA_MESSAGE_GET_VARIABLES) {
+      if (full || is_in_overflow(event)) {
+        if (network)
+          network->requests_dropped++;
+        return;
+      }
+    } else if (full) {
+      // the events already queued from the client are ignored once it is dropped
+      if (network && network->drop_client(event.stream)) {
+        log_warn("Disconnected the client of network %d: too many messages are waiting",
+                 event.port);
+        overflow.push_back({AsebaInbound::DROPPED, event.port, event.stream, 0, {}});
+      }
+      return;
+    }
+    overflow_depth[event.stream]++;
+  }
+  overflow.push_back(std::move(event));
+}
+
+bool AsebaHub::is_in_overflow(const AsebaInbound &event) const {
+  for (const auto &e : overflow) {
+    if (e.kind == AsebaInbound::DATA && e.stream == event.stream && e.source == event.source &&
+        e.data.size() == event.data.size() &&
+        !memcmp(&e.data[0], &event.data[0], e.data.size()))
+      return true;
+  }
+  return false;
+}
+
+void AsebaHub::dispatch(AsebaInbound &event) {
+  // the network may have been removed meanwhile
+  const auto it = listeners.find(event.port);
+  if (it == listeners.end()) {
+    return;
+  }
+  AsebaDashel *network = it->second;
+  switch (event.kind) {
+  case AsebaInbound::DATA:
+    network->receive(event.stream, event.source, event.data);
+    break;
+  case AsebaInbound::CONNECTED:
+    network->stats.connections++;
+    network->simulation_connection = event.connection;
+    break;
+  case AsebaInbound::DISCONNECTED:
+    network->clear_breakpoints();
+    break;
+  case AsebaInbound::DROPPED:
+    network->stats.clients_dropped++;
+    network->clear_breakpoints();
+    break;
+  }
+}
+
+void AsebaHub::queue_for_client(AsebaOutbound &message) {
+  const auto it = listeners.find(message.port);
+  if (it != listeners.end() && it->second->stream &&
+      it->second->connection == message.connection) {
+    it->second->outbound.push(std::move(message.frame));
+  }
+}
+
+void AsebaHub::write_outbound(bool defer_blocking) {
+  if (outbound) {
+    AsebaOutbound message;
+    while (outbound->pop(message)) {
+      queue_for_client(message);
+    }
+  }
+  for (const auto &[port, network] : listeners) {
+    Dashel::Stream *stream = network->stream;
+    if (defer_blocking && stream && network->outbound.policy == OutboundQueue::BLOCK) {
+      if (!network->outbound.size())
+        continue;
+      blocking.emplace_back(stream, std::vector<std::vector<uint8_t>>());
+      network->outbound.take(blocking.back().second);
+    } else {
+      network->write_outbound();
+    }
+  }
+}
+
+void AsebaHub::close_streams() {
+  for (const auto &[port, network] : listeners) {
+    network->close_streams();
+  }
+  for (auto stream : closing) {
+    closeStream(stream);
+  }
+  closing.clear();
+}
+
+// Serves plain text to local HTTP clients, e.g., counters to a Prometheus scraper
+class AsebaStatsServer : public Dashel::Hub {
+private:
+  std::function<std::string()> content;
+  std::map<Dashel::Stream *, std::string> requests;
+  std::set<Dashel::Stream *> toDisconnect;
+
+public:
+  AsebaStatsServer(int port, std::function<std::string()> content) : content(content) {
+    connect("tcpin:port=" + std::to_string(port) + ";address=127.0.0.1");
+  }
+
+  void spin() {
+    step(0);
+    for (auto stream : toDisconnect) {
+      closeStream(stream);
+    }
+    toDisconnect.clear();
+  }
+
+protected:
+  void incomingData(Dashel::Stream *stream) override {
+    std::string &request = requests[stream];
+    char c;
+    stream->read(&c, 1);
+    request += c;
+    if (request.size() > 4096) {
+      toDisconnect.insert(stream);
+      return;
+    }
+    // we answer any request with the same content, once the headers are complete
+    if (request.size() < 4 || request.compare(request.size() - 4, 4, "\r\n\r\n"))
+      return;
+    const std::string body = content();
+    const std::string header = "HTTP/1.0 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n";
+    try {
+      stream->write(header.data(), header.size());
+      stream->write(body.data(), body.size());
+      stream->flush();
+    } catch (Dashel::DashelException &e) {
+      log_warn("Cannot write stats: %s", stream->getFailReason().c_str());
+    }
+    requests.erase(stream);
+    toDisconnect.insert(stream);
+  }
+
+  void connectionClosed(Dashel::Stream *stream, bool abnormal) override {
+    requests.erase(stream);
+    toDisconnect.erase(stream);
+  }
+};
+
 // --------------  node collections
 
 namespace Aseba {
@@ -372,6 +879,7 @@ AsebaDashel *network_with_port(int port, bool create = false) {
   if (networks.count(port))
     return networks[port];
   if (create) {
+    auto lock = shared_hub().guard();
     networks[port] = new AsebaDashel(port);
     log_info("Added network with port %d", port);
     return networks[port];
@@ -385,11 +893,13 @@ void remove_network_with_port(int port) {
   AsebaDashel *network = networks[port];
   networks.erase(port);
   log_info("Removed network with port %d", port);
+  auto lock = shared_hub().guard();
   delete network;
 }
 
 void remove_all_networks() {
   log_info("Will remove all networks");
+  auto lock = shared_hub().guard();
   for (auto kv : networks) {
     delete kv.second;
   }
@@ -414,22 +924,31 @@ DynamicAsebaNode *node_for_vm(AsebaVMState *vm) {
 
 // handle -> nodes
 static std::map<int, DynamicAsebaNode *> nodes;
+// the same, indexed by handle (or NULL), as handles are the lowest free uids
+static std::vector<DynamicAsebaNode *> nodes_by_handle;
 
 DynamicAsebaNode *node_with_handle(int handle) {
-  if (nodes.count(handle))
-    return nodes.at(handle);
-  return NULL;
+  if (handle < 0 || (size_t)handle >= nodes_by_handle.size())
+    return NULL;
+  return nodes_by_handle[handle];
 }
 
 void add_node(DynamicAsebaNode *node, AsebaDashel *network, int handle) {
   endpoints[&(node->vm)] = std::make_pair(network, node);
   nodes[handle] = node;
+  if ((size_t)handle >= nodes_by_handle.size())
+    nodes_by_handle.resize(handle + 1, NULL);
+  nodes_by_handle[handle] = node;
+  auto lock = shared_hub().guard();
   network->add_node(node);
 }
 
 void remove_node(DynamicAsebaNode *node, AsebaDashel *network, int handle) {
   endpoints.erase(&(node->vm));
   nodes.erase(handle);
+  if ((size_t)handle < nodes_by_handle.size())
+    nodes_by_handle[handle] = NULL;
+  auto lock = shared_hub().guard();
   network->remove_node(node);
 }
 
@@ -473,12 +992,153 @@ void destroy_node(unsigned uid) {
 }
 
 void destroy_all_nodes() {
-  auto it = nodes.cbegin();
-  while (it != nodes.cend()) {
+  // `remove_node` erases the node
+  while (!nodes.empty()) {
+    const auto it = nodes.cbegin();
     AsebaDashel *network = network_for_vm(&(it->second->vm));
     remove_node(it->second, network, it->first);
-    nodes.erase(it++);
   }
+  nodes_by_handle.clear();
+}
+
+std::map<int, AsebaNetworkStats> network_stats() {
+  std::map<int, AsebaNetworkStats> stats;
+  // NOTE(Jerome): without locking the hub, as the counters of the queues are atomics
+  for (const auto &[port, network] : networks) {
+    AsebaNetworkStats &s = stats[port];
+    s = network->stats;
+    s.clients = network->stream ? 1 : 0;
+    s.requests_dropped = network->requests_dropped;
+    s.messages_dropped += network->outbound.dropped;
+    s.messages_coalesced = network->outbound.coalesced;
+    s.queue_depth = network->outbound.size();
+    s.max_queue_depth = network->outbound.max_depth;
+  }
+  return stats;
+}
+
+bool configure_outbound_queue(int policy, unsigned capacity) {
+  if (policy < OutboundQueue::BLOCK || policy > OutboundQueue::LATEST) {
+    log_error("Unknown outbound queue policy %d", policy);
+    return false;
+  }
+  const auto p = static_cast<OutboundQueue::Policy>(policy);
+  capacity = std::max(capacity, 1u);
+  auto lock = shared_hub().guard();
+  AsebaDashel::configure_outbound(p, capacity);
+  for (const auto &[port, network] : networks) {
+    network->outbound.policy = p;
+    network->outbound.capacity = capacity;
+  }
+  log_info("Configured outbound queues: policy=%d, capacity=%u", policy, capacity);
+  return true;
+}
+
+std::map<int, const DynamicAsebaNode *> all_nodes() {
+  return std::map<int, const DynamicAsebaNode *>(nodes.begin(), nodes.end());
+}
+
+template <typename T>
+static void write_metric(std::ostringstream &out, const std::string &name, const char *type,
+                         const char *help, const std::map<std::string, T> &values) {
+  out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+  for (const auto &[labels, value] : values) {
+    out << name << "{" << labels << "} " << value << "\n";
+  }
+}
+
+std::string format_stats() {
+  std::ostringstream out;
+  const auto label = [](const char *key, int value) {
+    return std::string(key) + "=\"" + std::to_string(value) + "\"";
+  };
+  std::map<std::string, uint64_t> runs, instructions, emitted, interrupted, dropped, calls,
+      lua_calls, natives;
+  std::map<std::string, double> lua_time;
+  for (const auto &[uid, node] : nodes) {
+    const std::string l = label("node", uid);
+    const AsebaNodeStats &s = node->stats;
+    runs[l] = s.vm_runs;
+    instructions[l] = s.vm_instructions;
+    emitted[l] = s.events_emitted;
+    interrupted[l] = s.events_interrupted;
+    dropped[l] = s.events_dropped;
+    lua_calls[l] = s.lua_calls;
+    lua_time[l] = s.lua_time;
+    for (size_t i = 0; i < s.native_calls.size(); i++) {
+      if (s.native_calls[i]) natives[l + "," + label("function", i)] = s.native_calls[i];
+    }
+  }
+  write_metric(out, "aseba_node_vm_runs_total", "counter", "VM runs", runs);
+  write_metric(out, "aseba_node_vm_instructions_total", "counter", "VM instructions",
+               instructions);
+  write_metric(out, "aseba_node_events_emitted_total", "counter", "Local events emitted",
+               emitted);
+  write_metric(out, "aseba_node_events_interrupted_total", "counter",
+               "Local events that killed a running event", interrupted);
+  write_metric(out, "aseba_node_events_dropped_total", "counter", "Local events dropped",
+               dropped);
+  write_metric(out, "aseba_node_native_calls_total", "counter", "Native function calls",
+               natives);
+  write_metric(out, "aseba_node_lua_calls_total", "counter", "Lua function calls", lua_calls);
+  write_metric(out, "aseba_node_lua_seconds_total", "counter", "Time spent in Lua functions",
+               lua_time);
+  std::map<std::string, uint64_t> messages_in, bytes_in, messages_out, bytes_out, connections,
+      clients, clients_dropped, requests_dropped, dropped_out, coalesced_out, depth, max_depth;
+  for (const auto &[port, s] : network_stats()) {
+    const std::string l = label("port", port);
+    messages_in[l] = s.messages_in;
+    bytes_in[l] = s.bytes_in;
+    messages_out[l] = s.messages_out;
+    bytes_out[l] = s.bytes_out;
+    connections[l] = s.connections;
+    clients[l] = s.clients;
+    clients_dropped[l] = s.clients_dropped;
+    requests_dropped[l] = s.requests_dropped;
+    dropped_out[l] = s.messages_dropped;
+    coalesced_out[l] = s.messages_coalesced;
+    depth[l] = s.queue_depth;
+    max_depth[l] = s.max_queue_depth;
+  }
+  write_metric(out, "aseba_network_messages_received_total", "counter", "Messages received",
+               messages_in);
+  write_metric(out, "aseba_network_bytes_received_total", "counter", "Bytes received",
+               bytes_in);
+  write_metric(out, "aseba_network_messages_sent_total", "counter", "Messages sent",
+               messages_out);
+  write_metric(out, "aseba_network_bytes_sent_total", "counter", "Bytes sent", bytes_out);
+  write_metric(out, "aseba_network_messages_dropped_total", "counter",
+               "Messages not sent because an outbound queue was full", dropped_out);
+  write_metric(out, "aseba_network_messages_coalesced_total", "counter",
+               "Messages replaced by a newer value while queued", coalesced_out);
+  write_metric(out, "aseba_network_queue_depth", "gauge", "Messages queued for the client",
+               depth);
+  write_metric(out, "aseba_network_queue_max_depth", "gauge",
+               "Largest number of messages queued for the client", max_depth);
+  write_metric(out, "aseba_network_connections_total", "counter", "Accepted connections",
+               connections);
+  write_metric(out, "aseba_network_clients", "gauge", "Connected clients", clients);
+  write_metric(out, "aseba_network_clients_dropped_total", "counter",
+               "Clients disconnected for sending more messages than could be queued",
+               clients_dropped);
+  write_metric(out, "aseba_network_requests_dropped_total", "counter",
+               "Requests dropped while the simulation was not handling them", requests_dropped);
+  return out.str();
+}
+
+static std::unique_ptr<AsebaStatsServer> stats_server;
+
+bool serve_stats(int port) {
+  stats_server.reset();
+  if (port <= 0) return true;
+  try {
+    stats_server = std::make_unique<AsebaStatsServer>(port, format_stats);
+  } catch (Dashel::DashelException &e) {
+    log_error("Cannot serve stats on port %d: %s", port, e.what());
+    return false;
+  }
+  log_info("Serving stats on http://127.0.0.1:%d", port);
+  return true;
 }
 
 std::map<unsigned, std::vector<DynamicAsebaNode *>> node_list(unsigned port) {
@@ -508,19 +1168,31 @@ extern "C" void AsebaPutVmToSleep(AsebaVMState *vm) {
 
 extern "C" void AsebaSendBuffer(AsebaVMState *vm, const uint8_t *data,
                                 uint16_t length) {
-  Dashel::Stream *stream = network_for_vm(vm)->stream;
+  AsebaDashel *network = network_for_vm(vm);
+  Dashel::Stream *stream = network->stream;
   if (stream) {
-    try {
-      uint16_t temp;
-      temp = bswap16(length - 2);
-      stream->write(&temp, 2);
-      temp = bswap16(vm->nodeId);
-      stream->write(&temp, 2);
-      stream->write(data, length);
-      stream->flush();
-    } catch (Dashel::DashelException e) {
-      log_warn("Cannot write to socket: %s", stream->getFailReason().c_str());
+    TRACE_SCOPE("send", vm->nodeId, length);
+    network->stats.messages_out++;
+    network->stats.bytes_out += length + 4;
+    std::vector<uint8_t> frame(length + 4);
+    uint16_t temp = bswap16(length - 2);
+    memcpy(&frame[0], &temp, 2);
+    temp = bswap16(vm->nodeId);
+    memcpy(&frame[2], &temp, 2);
+    memcpy(&frame[4], data, length);
+    AsebaHub &hub = shared_hub();
+    if (hub.running) {
+      // written later by the I/O thread
+      const bool droppable = network->outbound.policy != OutboundQueue::BLOCK &&
+                             OutboundQueue::droppable(frame);
+      if (!hub.send(network->get_port(), network->simulation_connection, std::move(frame),
+                    droppable)) {
+        network->stats.messages_dropped++;
+      }
+      return;
     }
+    network->outbound.push(std::move(frame));
+    network->write_outbound();
   }
 }
 
@@ -537,17 +1209,17 @@ extern "C" uint16_t AsebaGetBuffer(AsebaVMState *vm, uint8_t *data,
 extern "C" const AsebaVMDescription *AsebaGetVMDescription(AsebaVMState *vm) {
   // printf("Got Node description name: %s\n",
   // node_with_vm[vm]->node_description->name);
-  return node_for_vm(vm)->variables_description;
+  return node_for_vm(vm)->descriptions->variables();
 }
 
 extern "C" const AsebaNativeFunctionDescription *const *
 AsebaGetNativeFunctionsDescriptions(AsebaVMState *vm) {
-  return node_for_vm(vm)->functions_description;
+  return node_for_vm(vm)->descriptions->functions();
 }
 
 extern "C" const AsebaLocalEventDescription *
 AsebaGetLocalEventsDescriptions(AsebaVMState *vm) {
-  return node_for_vm(vm)->events_description;
+  return node_for_vm(vm)->descriptions->events();
 }
 
 extern "C" void AsebaNativeFunction(AsebaVMState *vm, uint16_t id) {
@@ -555,6 +1227,8 @@ extern "C" void AsebaNativeFunction(AsebaVMState *vm, uint16_t id) {
   DynamicAsebaNode *node = node_for_vm(vm);
   if (!node)
     return;
+  TRACE_SCOPE("native", vm->nodeId, id);
+  node->stats.count_native_call(id);
   if (id < node->number_of_native_function) {
     node->native_functions()[id](vm);
     return;
@@ -625,10 +1299,41 @@ extern "C" void AsebaVMErrorCB(AsebaVMState *vm, const char *message) {
 }
 // Plugin class helpers
 
+void configure_io_thread(bool enabled, unsigned capacity) {
+  AsebaHub &hub = shared_hub();
+  if (enabled) {
+    hub.start_thread(std::max(capacity, 1u));
+  } else {
+    hub.stop_thread();
+  }
+}
+
 void spin(float dt) {
+  AsebaHub &hub = shared_hub();
+  if (hub.running) {
+    // the I/O thread has already read the streams
+    PROFILE_SCOPE(DASHEL);
+    hub.retry_spilled();
+    hub.drain();
+  } else if (!networks.empty()) {
+    // a single wait for the streams of all networks
+    PROFILE_SCOPE(DASHEL);
+    hub.step_streams();
+  }
   for (const auto &kv : networks) {
     kv.second->spin(dt);
   }
+  if (!hub.running) {
+    // what could not be written without blocking at previous steps
+    hub.write_outbound();
+    hub.close_streams();
+  }
+}
+
+void spin_stats() {
+  if (stats_server) {
+    stats_server->spin();
+  }
 }
 } // namespace Aseba
 
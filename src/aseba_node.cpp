@@ -2,24 +2,88 @@
 
 #include "vm/natives.h"
 #include "common/productids.h"
+#include <map>
+#include <memory>
 #include <string>
 
 
-// char *dydata(std::string value)
-// {
-//   char *c = (char *) malloc(value.length() + 1);
-//   value.copy(c, value.length());
-//   c[value.length()] = 0;
-//   return c;
-// }
-
-char * dydata(std::string value) {
-  // printf("dydata for %s %lu\n", value.c_str(), value.length());
-  char *c = (char *) malloc(value.length() + 1);
-  value.copy(c, value.length());
-  c[value.length()] = 0;
-  // printf("-> %p %s\n", (void *)c, c);
-  return c;
+// Descriptions currently in use, keyed by their (narrow) content, so that nodes
+// with identical descriptions share the same widened copy.
+static std::map<std::string, std::weak_ptr<const Aseba::TargetDescription>> target_descriptions;
+
+static void add_to_fingerprint(std::string & fingerprint, const char * text) {
+  fingerprint += text;
+  fingerprint += '\0';
+}
+
+static void add_to_fingerprint(std::string & fingerprint, int value) {
+  fingerprint += std::to_string(value);
+  fingerprint += '\0';
+}
+
+std::shared_ptr<const Aseba::TargetDescription> DynamicAsebaNode::build_description() const {
+  std::string fingerprint;
+  add_to_fingerprint(fingerprint, name.c_str());
+  add_to_fingerprint(fingerprint, vm.bytecodeSize);
+  add_to_fingerprint(fingerprint, vm.variablesSize);
+  add_to_fingerprint(fingerprint, vm.stackSize);
+  for (const AsebaVariableDescription * v = descriptions->variables()->variables; v->name != NULL; v++) {
+    add_to_fingerprint(fingerprint, v->name);
+    add_to_fingerprint(fingerprint, v->size);
+  }
+  fingerprint += '\1';
+  for (const AsebaLocalEventDescription * e = descriptions->events(); e->name != NULL; e++) {
+    add_to_fingerprint(fingerprint, e->name);
+  }
+  for (const AsebaNativeFunctionDescription * const * fd = descriptions->functions(); * fd != 0; fd++) {
+    fingerprint += '\1';
+    add_to_fingerprint(fingerprint, (*fd)->name);
+    for (const AsebaNativeFunctionArgumentDescription * argument = (*fd)->arguments; argument->name != 0;
+         argument++) {
+      add_to_fingerprint(fingerprint, argument->name);
+      add_to_fingerprint(fingerprint, argument->size);
+    }
+  }
+  auto it = target_descriptions.find(fingerprint);
+  if (it != target_descriptions.end()) {
+    if (auto shared = it->second.lock()) {
+      return shared;
+    }
+  }
+
+  auto d = std::make_shared<Aseba::TargetDescription>();
+  d->name = widen(name);
+  d->bytecodeSize = vm.bytecodeSize;
+  d->variablesSize = vm.variablesSize;
+  d->stackSize = vm.stackSize;
+  for (const AsebaVariableDescription * v = descriptions->variables()->variables; v->name != NULL; v++) {
+    d->namedVariables.push_back(Aseba::TargetDescription::NamedVariable(widen(v->name), v->size));
+  }
+  for (const AsebaLocalEventDescription * e = descriptions->events(); e->name != NULL; e++) {
+    Aseba::TargetDescription::LocalEvent event{widen(e->name), std::wstring()};
+    d->localEvents.push_back(event);
+  }
+  for (const AsebaNativeFunctionDescription * const * fd = descriptions->functions(); * fd != 0; fd++) {
+    Aseba::TargetDescription::NativeFunction f;
+    f.name = widen((*fd)->name);
+    for (const AsebaNativeFunctionArgumentDescription * argument = (*fd)->arguments; argument->name != 0;
+         argument++) {
+      f.parameters.push_back(
+          Aseba::TargetDescription::NativeFunctionParameter(widen(argument->name), argument->size));
+    }
+    d->nativeFunctions.push_back(f);
+  }
+  // drop descriptions no longer used by any node
+  for (auto i = target_descriptions.begin(); i != target_descriptions.end();) {
+    if (i->second.expired()) {
+      i = target_descriptions.erase(i);
+    } else {
+      i++;
+    }
+  }
+  target_descriptions[fingerprint] = d;
+  log_debug("Built description for node %s", name.c_str());
+  return d;
 }
 
 #if ASEBA_PROTOCOL_VERSION < 9
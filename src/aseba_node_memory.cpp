@@ -0,0 +1,55 @@
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "aseba_node_memory.h"
+#include "logging.h"
+
+// Slabs are allocated in chunks of this many
+#define SLABS_PER_CHUNK 16
+
+static size_t aligned(size_t size) {
+  return (size + AsebaNodeArena::alignment - 1) / AsebaNodeArena::alignment *
+         AsebaNodeArena::alignment;
+}
+
+// variables first: they are the most accessed, by the VM and by the robot step
+static AsebaNodeSlab layout_slab(const AsebaVMLayout &layout, char *memory) {
+  AsebaNodeSlab slab;
+  slab.variables = reinterpret_cast<int16_t *>(memory);
+  memory += aligned(layout.variables_size * sizeof(int16_t));
+  slab.stack = reinterpret_cast<int16_t *>(memory);
+  memory += aligned(layout.stack_size * sizeof(int16_t));
+  slab.bytecode = reinterpret_cast<uint16_t *>(memory);
+  return slab;
+}
+
+AsebaNodeSlab AsebaNodeArena::allocate(const AsebaVMLayout &layout) {
+  Pool &pool = pools[layout];
+  if (!pool.slab_size) {
+    pool.slab_size = aligned(layout.variables_size * sizeof(int16_t)) +
+                     aligned(layout.stack_size * sizeof(int16_t)) +
+                     aligned(layout.bytecode_size * sizeof(uint16_t));
+  }
+  if (pool.free_slabs.empty()) {
+    char *chunk = static_cast<char *>(
+        ::operator new(pool.slab_size * SLABS_PER_CHUNK, std::align_val_t(alignment)));
+    chunks.push_back(chunk);
+    // push in reverse, so that slabs are handed out in address order
+    for (int i = SLABS_PER_CHUNK - 1; i >= 0; i--) {
+      pool.free_slabs.push_back(chunk + i * pool.slab_size);
+    }
+    log_debug("Allocated node memory for %d nodes (%lu bytes each)", SLABS_PER_CHUNK,
+              pool.slab_size);
+  }
+  char *memory = pool.free_slabs.back();
+  pool.free_slabs.pop_back();
+  memset(memory, 0, pool.slab_size);
+  return layout_slab(layout, memory);
+}
+
+void AsebaNodeArena::release(const AsebaVMLayout &layout, const AsebaNodeSlab &slab) {
+  auto it = pools.find(layout);
+  if (it == pools.end()) return;
+  it->second.free_slabs.push_back(reinterpret_cast<char *>(slab.variables));
+}
@@ -1,6 +1,7 @@
 #include "common/consts.h"
 
 #include "aseba_script.h"
+#include "aseba_script_cache.h"
 #include "logging.h"
 // #include "asebaros/utils.h"
 
@@ -16,7 +17,15 @@ static bool compile_script(const Aseba::TargetDescription *description,
                            const Aseba::CommonDefinitions *common_definitions,
                            const std::string &code,
                            Aseba::VariablesMap &variable_map,
-                           Aseba::BytecodeVector &bytecode) {
+                           Aseba::BytecodeVector &bytecode,
+                           std::string *error_message) {
+  const AsebaScriptCache::Key key =
+      AsebaScriptCache::key(description, common_definitions, code);
+  if (auto entry = AsebaScriptCache::get(key)) {
+    variable_map = entry->variables;
+    bytecode = entry->bytecode;
+    return true;
+  }
   std::wistringstream is(widen(code));
   unsigned allocatedVariablesCount;
   Aseba::Compiler compiler;
@@ -27,9 +36,18 @@ static bool compile_script(const Aseba::TargetDescription *description,
   if (!result) {
     LOG_ERROR("Failed to compile script for node %ls: %ls",
               description->name.c_str(), error.toWString().c_str());
+    if (error_message) {
+      *error_message = narrow(error.toWString());
+    }
     return false;
   }
   variable_map = *compiler.getVariablesMap();
+  if (AsebaScriptCache::is_enabled()) {
+    auto entry = std::make_shared<AsebaScriptCache::Entry>();
+    entry->bytecode = bytecode;
+    entry->variables = variable_map;
+    AsebaScriptCache::put(key, entry);
+  }
   return true;
 }
 
@@ -167,12 +185,16 @@ std::shared_ptr<AsebaScript> AsebaScript::from_file(const std::string &path) {
 bool AsebaScript::compile(unsigned node_id,
                           const Aseba::TargetDescription *description,
                           Aseba::VariablesMap &variable_map,
-                          Aseba::BytecodeVector &bytecode) {
+                          Aseba::BytecodeVector &bytecode,
+                          std::string *error_message) {
   std::string name = narrow(description->name);
   if (!code.count(name)) {
     LOG_WARN("No node in script for name %s: won't compile and load to Aseba "
              "node %d",
              name.c_str(), node_id);
+    if (error_message) {
+      *error_message = "No node in script for name " + name;
+    }
     return false;
   }
   std::string aesl_code;
@@ -188,5 +210,5 @@ bool AsebaScript::compile(unsigned node_id,
              name.c_str(), node_id, node_id);
   }
   return compile_script(description, &common_definitions, aesl_code,
-                        variable_map, bytecode);
+                        variable_map, bytecode, error_message);
 }
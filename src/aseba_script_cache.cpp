@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <fstream>
+
+#include "aseba_script.h"
+#include "aseba_script_cache.h"
+#include "logging.h"
+
+// Bump when the on-disk format or the hashed content changes
+#define CACHE_FORMAT_VERSION 1
+static const char cache_magic[4] = {'A', 'S', 'B', 'C'};
+
+// 64-bit FNV-1a
+class Hasher {
+ public:
+  uint64_t value = 0xcbf29ce484222325ULL;
+
+  void add(const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+      value ^= bytes[i];
+      value *= 0x100000001b3ULL;
+    }
+  }
+
+  void add(uint32_t number) { add(&number, sizeof(number)); }
+
+  void add(int32_t number) { add(&number, sizeof(number)); }
+
+  void add(const std::string &text) {
+    add((uint32_t)text.size());
+    add(text.data(), text.size());
+  }
+
+  // wchar_t has a platform dependent size: hash code points as 32-bit integers
+  void add(const std::wstring &text) {
+    add((uint32_t)text.size());
+    for (wchar_t c : text) {
+      add((uint32_t)c);
+    }
+  }
+};
+
+AsebaScriptCache::Key AsebaScriptCache::key(const Aseba::TargetDescription *description,
+                                            const Aseba::CommonDefinitions *common_definitions,
+                                            const std::string &code) {
+  Hasher h;
+  h.add((uint32_t)CACHE_FORMAT_VERSION);
+  h.add(description->name);
+  h.add((uint32_t)description->bytecodeSize);
+  h.add((uint32_t)description->variablesSize);
+  h.add((uint32_t)description->stackSize);
+  h.add((uint32_t)description->namedVariables.size());
+  for (const auto &v : description->namedVariables) {
+    h.add(v.name);
+    h.add((uint32_t)v.size);
+  }
+  h.add((uint32_t)description->localEvents.size());
+  for (const auto &e : description->localEvents) {
+    h.add(e.name);
+  }
+  h.add((uint32_t)description->nativeFunctions.size());
+  for (const auto &f : description->nativeFunctions) {
+    h.add(f.name);
+    h.add((uint32_t)f.parameters.size());
+    for (const auto &p : f.parameters) {
+      h.add(p.name);
+      h.add((int32_t)p.size);
+    }
+  }
+  h.add((uint32_t)common_definitions->events.size());
+  for (const auto &e : common_definitions->events) {
+    h.add(e.name);
+    h.add((int32_t)e.value);
+  }
+  h.add((uint32_t)common_definitions->constants.size());
+  for (const auto &c : common_definitions->constants) {
+    h.add(c.name);
+    h.add((int32_t)c.value);
+  }
+  h.add(code);
+  return h.value;
+}
+
+std::shared_ptr<const AsebaScriptCache::Entry> AsebaScriptCache::get(Key key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!enabled) return nullptr;
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    log_debug("Script cache hit for %016llx", (unsigned long long)key);
+    return it->second;
+  }
+  if (directory.empty()) return nullptr;
+  auto entry = load(key);
+  if (entry) {
+    log_debug("Script cache hit on disk for %016llx", (unsigned long long)key);
+    entries[key] = entry;
+  }
+  return entry;
+}
+
+void AsebaScriptCache::put(Key key, const std::shared_ptr<const Entry> &entry) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!enabled) return;
+  entries[key] = entry;
+  if (!directory.empty()) {
+    save(key, *entry);
+  }
+}
+
+void AsebaScriptCache::configure(bool enabled_, const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  enabled = enabled_;
+  directory = enabled ? std::filesystem::path(path) : std::filesystem::path();
+  if (!enabled) {
+    entries.clear();
+  }
+  if (!directory.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+      log_warn("Cannot create script cache directory %s: %s", path.c_str(), ec.message().c_str());
+      directory.clear();
+    }
+  }
+  log_info("Configured script cache: enabled=%d, directory=%s", enabled,
+           directory.string().c_str());
+}
+
+void AsebaScriptCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+}
+
+std::filesystem::path AsebaScriptCache::path_for_key(Key key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bytecode", (unsigned long long)key);
+  return directory / std::filesystem::path(name);
+}
+
+template <typename T>
+static bool read_value(std::istream &stream, T &value) {
+  stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+  return bool(stream);
+}
+
+template <typename T>
+static void write_value(std::ostream &stream, const T &value) {
+  stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Layout (native endianness, the cache is not meant to be shared between machines):
+// magic[4], version (u32), key (u64),
+// number of words (u32), [word (u16), line (u16)] * number of words,
+// number of variables (u32), [name length (u32), utf8 name, position (u32), size (u32)] * ...
+std::shared_ptr<const AsebaScriptCache::Entry> AsebaScriptCache::load(Key key) {
+  std::ifstream stream(path_for_key(key), std::ios::binary);
+  if (!stream) return nullptr;
+  char magic[4];
+  uint32_t version;
+  uint64_t stored_key;
+  stream.read(magic, sizeof(magic));
+  if (!stream || !std::equal(magic, magic + 4, cache_magic) || !read_value(stream, version) ||
+      version != CACHE_FORMAT_VERSION || !read_value(stream, stored_key) || stored_key != key) {
+    log_warn("Ignoring invalid script cache file %s", path_for_key(key).string().c_str());
+    return nullptr;
+  }
+  auto entry = std::make_shared<Entry>();
+  uint32_t number;
+  if (!read_value(stream, number)) return nullptr;
+  for (uint32_t i = 0; i < number; i++) {
+    uint16_t word, line;
+    if (!read_value(stream, word) || !read_value(stream, line)) return nullptr;
+    entry->bytecode.push_back(Aseba::BytecodeElement(word, line));
+  }
+  if (!read_value(stream, number)) return nullptr;
+  for (uint32_t i = 0; i < number; i++) {
+    uint32_t length, position, size;
+    if (!read_value(stream, length)) return nullptr;
+    std::string name(length, '\0');
+    stream.read(&name[0], length);
+    if (!stream || !read_value(stream, position) || !read_value(stream, size)) return nullptr;
+    entry->variables[widen(name)] = std::make_pair(position, size);
+  }
+  return entry;
+}
+
+void AsebaScriptCache::save(Key key, const Entry &entry) {
+  const std::filesystem::path path = path_for_key(key);
+  std::filesystem::path tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream stream(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!stream) {
+      log_warn("Cannot write script cache file %s", tmp_path.string().c_str());
+      return;
+    }
+    stream.write(cache_magic, sizeof(cache_magic));
+    write_value(stream, (uint32_t)CACHE_FORMAT_VERSION);
+    write_value(stream, (uint64_t)key);
+    write_value(stream, (uint32_t)entry.bytecode.size());
+    for (const auto &element : entry.bytecode) {
+      write_value(stream, (uint16_t)element.bytecode);
+      write_value(stream, (uint16_t)element.line);
+    }
+    write_value(stream, (uint32_t)entry.variables.size());
+    for (const auto &[name, value] : entry.variables) {
+      const std::string n = narrow(name);
+      write_value(stream, (uint32_t)n.size());
+      stream.write(n.data(), n.size());
+      write_value(stream, (uint32_t)value.first);
+      write_value(stream, (uint32_t)value.second);
+    }
+  }
+  // write and rename, so that concurrent sessions never read a partial file
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    log_warn("Cannot write script cache file %s: %s", path.string().c_str(), ec.message().c_str());
+  }
+}
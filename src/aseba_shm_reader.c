@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aseba_shm.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+  char *memory;
+  size_t size;
+#ifdef _WIN32
+  HANDLE handle;
+#endif
+} mapping_t;
+
+struct aseba_shm_reader {
+  mapping_t mapping;
+};
+
+struct aseba_shm_controller {
+  mapping_t mapping;
+};
+
+struct aseba_shm_cameras {
+  mapping_t mapping;
+};
+
+#ifdef _MSC_VER
+static uint64_t load_acquire(const uint64_t *value) {
+  uint64_t v = *(const volatile uint64_t *)value;
+  MemoryBarrier();
+  return v;
+}
+static void store_release(uint64_t *target, uint64_t value) {
+  MemoryBarrier();
+  *(volatile uint64_t *)target = value;
+}
+static void fence_acquire(void) { MemoryBarrier(); }
+#else
+static uint64_t load_acquire(const uint64_t *value) {
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+static void store_release(uint64_t *target, uint64_t value) {
+  __atomic_store_n(target, value, __ATOMIC_RELEASE);
+}
+static void fence_acquire(void) { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+#endif
+
+static void unmap(mapping_t *mapping) {
+#ifdef _WIN32
+  if (mapping->memory) UnmapViewOfFile(mapping->memory);
+  if (mapping->handle) CloseHandle(mapping->handle);
+#else
+  if (mapping->memory) munmap(mapping->memory, mapping->size);
+#endif
+  mapping->memory = NULL;
+}
+
+/* Returns 0 on failure */
+static int map(const char *name, int writable, size_t min_size, mapping_t *mapping) {
+#ifdef _WIN32
+  MEMORY_BASIC_INFORMATION info;
+  const DWORD access = writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ;
+  mapping->handle = OpenFileMappingA(access, FALSE, name);
+  if (!mapping->handle) return 0;
+  mapping->memory = (char *)MapViewOfFile(mapping->handle, access, 0, 0, 0);
+  if (!mapping->memory || !VirtualQuery(mapping->memory, &info, sizeof(info))) {
+    unmap(mapping);
+    return 0;
+  }
+  mapping->size = info.RegionSize;
+#else
+  char path[256];
+  struct stat st;
+  int fd;
+  snprintf(path, sizeof(path), "/%s", name);
+  fd = shm_open(path, writable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return 0;
+  }
+  mapping->size = st.st_size;
+  mapping->memory = (char *)mmap(NULL, mapping->size,
+                                 writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping->memory == MAP_FAILED) {
+    mapping->memory = NULL;
+    return 0;
+  }
+#endif
+  if (mapping->size < min_size) {
+    unmap(mapping);
+    return 0;
+  }
+  return 1;
+}
+
+/* Reader */
+
+static int is_compatible(const aseba_shm_header_t *header, size_t size) {
+  return header->magic == ASEBA_SHM_MAGIC && header->version == ASEBA_SHM_VERSION &&
+         header->buffer_offset[1] + header->buffer_size <= size;
+}
+
+aseba_shm_reader_t *aseba_shm_open(const char *name) {
+  aseba_shm_reader_t *reader = (aseba_shm_reader_t *)calloc(1, sizeof(aseba_shm_reader_t));
+  if (!reader) return NULL;
+  if (!map(name, 0, sizeof(aseba_shm_header_t), &reader->mapping) ||
+      !is_compatible((const aseba_shm_header_t *)reader->mapping.memory, reader->mapping.size)) {
+    aseba_shm_close(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+void aseba_shm_close(aseba_shm_reader_t *reader) {
+  if (!reader) return;
+  unmap(&reader->mapping);
+  free(reader);
+}
+
+const aseba_shm_header_t *aseba_shm_header(const aseba_shm_reader_t *reader) {
+  return (const aseba_shm_header_t *)reader->mapping.memory;
+}
+
+const aseba_shm_frame_t *aseba_shm_begin_read(const aseba_shm_reader_t *reader,
+                                              uint64_t *sequence) {
+  const aseba_shm_header_t *header = aseba_shm_header(reader);
+  *sequence = load_acquire(&header->sequence);
+  if (!*sequence) return NULL;
+  return (const aseba_shm_frame_t *)(reader->mapping.memory +
+                                     header->buffer_offset[*sequence % 2]);
+}
+
+int aseba_shm_end_read(const aseba_shm_reader_t *reader, uint64_t sequence) {
+  const aseba_shm_header_t *header = aseba_shm_header(reader);
+  fence_acquire();
+  return load_acquire(&header->writing) < sequence + 2;
+}
+
+/* Camera reader */
+
+aseba_shm_cameras_t *aseba_shm_open_cameras(const char *name) {
+  const aseba_shm_cameras_header_t *header;
+  aseba_shm_cameras_t *cameras = (aseba_shm_cameras_t *)calloc(1, sizeof(aseba_shm_cameras_t));
+  if (!cameras) return NULL;
+  if (!map(name, 0, sizeof(aseba_shm_cameras_header_t), &cameras->mapping)) {
+    aseba_shm_close_cameras(cameras);
+    return NULL;
+  }
+  header = (const aseba_shm_cameras_header_t *)cameras->mapping.memory;
+  if (header->magic != ASEBA_SHM_CAMERAS_MAGIC || header->version != ASEBA_SHM_VERSION ||
+      !header->depth ||
+      sizeof(aseba_shm_cameras_header_t) + header->max_cameras * header->camera_stride >
+          cameras->mapping.size) {
+    aseba_shm_close_cameras(cameras);
+    return NULL;
+  }
+  return cameras;
+}
+
+void aseba_shm_close_cameras(aseba_shm_cameras_t *cameras) {
+  if (!cameras) return;
+  unmap(&cameras->mapping);
+  free(cameras);
+}
+
+const aseba_shm_cameras_header_t *aseba_shm_cameras_header(const aseba_shm_cameras_t *cameras) {
+  return (const aseba_shm_cameras_header_t *)cameras->mapping.memory;
+}
+
+const aseba_shm_camera_t *aseba_shm_camera(const aseba_shm_cameras_t *cameras, uint32_t index) {
+  const aseba_shm_cameras_header_t *header = aseba_shm_cameras_header(cameras);
+  if (index >= header->max_cameras) return NULL;
+  return (const aseba_shm_camera_t *)((const char *)(header + 1) +
+                                      (uint64_t)index * header->camera_stride);
+}
+
+const aseba_shm_image_t *aseba_shm_begin_read_image(const aseba_shm_cameras_t *cameras,
+                                                    uint32_t index, uint64_t *frame) {
+  const aseba_shm_cameras_header_t *header = aseba_shm_cameras_header(cameras);
+  const aseba_shm_camera_t *camera = aseba_shm_camera(cameras, index);
+  *frame = camera ? load_acquire(&camera->frames) : 0;
+  if (!*frame) return NULL;
+  return (const aseba_shm_image_t *)((const char *)(camera + 1) +
+                                     ((*frame - 1) % header->depth) * header->image_stride);
+}
+
+int aseba_shm_end_read_image(const aseba_shm_cameras_t *cameras, uint32_t index,
+                             uint64_t frame) {
+  const aseba_shm_camera_t *camera = aseba_shm_camera(cameras, index);
+  if (!camera) return 0;
+  fence_acquire();
+  return load_acquire(&camera->writing) < frame + aseba_shm_cameras_header(cameras)->depth;
+}
+
+/* Controller */
+
+aseba_shm_controller_t *aseba_shm_open_controller(const char *name) {
+  const aseba_shm_ring_header_t *header;
+  aseba_shm_controller_t *controller =
+      (aseba_shm_controller_t *)calloc(1, sizeof(aseba_shm_controller_t));
+  if (!controller) return NULL;
+  if (!map(name, 1, sizeof(aseba_shm_ring_header_t), &controller->mapping)) {
+    aseba_shm_close_controller(controller);
+    return NULL;
+  }
+  header = (const aseba_shm_ring_header_t *)controller->mapping.memory;
+  if (header->magic != ASEBA_SHM_RING_MAGIC || header->version != ASEBA_SHM_VERSION ||
+      sizeof(aseba_shm_ring_header_t) + header->capacity * sizeof(aseba_shm_command_t) >
+          controller->mapping.size) {
+    aseba_shm_close_controller(controller);
+    return NULL;
+  }
+  return controller;
+}
+
+void aseba_shm_close_controller(aseba_shm_controller_t *controller) {
+  if (!controller) return;
+  unmap(&controller->mapping);
+  free(controller);
+}
+
+int aseba_shm_push_command(aseba_shm_controller_t *controller,
+                           const aseba_shm_command_t *command) {
+  aseba_shm_ring_header_t *header = (aseba_shm_ring_header_t *)controller->mapping.memory;
+  /* only written by this process */
+  const uint64_t head = header->head;
+  if (head - load_acquire(&header->tail) >= header->capacity) return 0;
+  aseba_shm_ring_commands(header)[head & (header->capacity - 1)] = *command;
+  store_release(&header->head, head + 1);
+  return 1;
+}
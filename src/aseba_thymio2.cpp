@@ -21,13 +21,16 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include "aseba_thymio2.h"
 #include "aseba_thymio2_natives.h"
+#include "profiler.h"
+#include "tracer.h"
 #include "common/productids.h"
 #include "common/utils/utils.h"
 
 AsebaThymio2::AsebaThymio2(int node_id, const std::string & _name,
                            const std::array<uint8_t, 16> & uuid_,
                            const std::string & friendly_name_):
-  CoppeliaSimAsebaNode(node_id, _name, uuid_, friendly_name_),
+  CoppeliaSimAsebaNode(node_id, _name, uuid_, friendly_name_,
+                       {BYTECODE_SIZE, STACK_SIZE, sizeof(thymio_variables_t) / sizeof(int16_t)}),
   // SingleVMNodeGlue(std::move(robotName), nodeId),
   // sdCardFileNumber(-1),
   timer0(std::bind(&AsebaThymio2::timer0Timeout, this), 0),
@@ -35,7 +38,7 @@ AsebaThymio2::AsebaThymio2(int node_id, const std::string & _name,
   timer100Hz(std::bind(&AsebaThymio2::timer100HzTimeout, this), 0.01),
   counter100Hz(0), oldTimerPeriod{0, 0}, oldMicThreshold(0), first(true),
   sound_duration(0), playing_sound(false), robot(nullptr) {
-  thymio_variables = reinterpret_cast<thymio_variables_t *>(&variables);
+  thymio_variables = reinterpret_cast<thymio_variables_t *>(variables);
 
   // this simulated Thymio complies with firmware 11 public API
 
@@ -69,7 +72,11 @@ inline int16_t aseba_acc(float a) {
 void AsebaThymio2::step(float dt) {
   // get physical variables
   //
-  robot->update_sensing(dt);
+  {
+    PROFILE_SCOPE(SENSING);
+    TRACE_SCOPE("sensing", vm.nodeId);
+    robot->update_sensing(dt);
+  }
 
   for (size_t i = 0; i < 7; i++) {
     thymio_variables->proxHorizontal[i] = robot->get_proximity_value(i);
@@ -248,6 +255,8 @@ void AsebaThymio2::step(float dt) {
 #endif
 
   first = false;
+  PROFILE_SCOPE(ACTUATION);
+  TRACE_SCOPE("actuation", vm.nodeId);
   robot->update_actuation(dt);
 }
 
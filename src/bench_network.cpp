@@ -0,0 +1,330 @@
+// Measures the throughput and latency of the Aseba network and VM path, without CoppeliaSim.
+//
+// Starts nodes on one or more ports, loads a synthetic script and drives them
+// from a local Dashel client running in its own thread: the client keeps `window` `ping`
+// events in flight for each node and each node answers with a `pong` event.
+//
+// Events are broadcast to all the nodes of a network, so a `ping` for another node
+// kills a handler that has not completed (e.g., with a large `--work`): pings that are not
+// answered in time are counted as lost and sent again.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "aseba_network.h"
+#include "aseba_script.h"
+#include "dashel/dashel.h"
+#include "logging.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// user events, numbered as declared in the script
+static const uint16_t PING = 0;
+static const uint16_t PONG = 1;
+
+static void show_usage(std::string name) {
+  std::cout << "Usage: " << name << " <option(s)>" << std::endl
+            << "Options:" << std::endl
+            << "  --help\t\t\tShow this help message" << std::endl
+            << "  --nodes=<N>\t\tNumber of nodes (default: 10)" << std::endl
+            << "  --ports=<M>\t\tNumber of networks, one per port (default: 1)" << std::endl
+            << "  --port=<PORT>\t\tFirst port (default: 33400)" << std::endl
+            << "  --window=<W>\t\tEvents in flight per node (default: 1)" << std::endl
+            << "  --work=<K>\t\tLoop iterations in the event handler (default: 0)" << std::endl
+            << "  --timeout=<MS>\tWhen to consider a ping lost [ms] (default: 1000)" << std::endl
+            << "  --duration=<S>\tDuration of the measure [s] (default: 5)" << std::endl
+            << "  --format=<F>\t\tjson or csv (default: json)" << std::endl
+            << "  --output=<PATH>\tWrite the results to a file (default: stdout)" << std::endl;
+}
+
+// [s] of CPU used by the calling thread
+static double thread_cpu_time() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+  auto to_seconds = [](const FILETIME & t) {
+    return ((uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 1e-7;
+  };
+  return to_seconds(kernel) + to_seconds(user);
+#else
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+static std::string script_for_node(unsigned uid, unsigned work) {
+  std::ostringstream code;
+  code << "var reply[1]\n"
+       << "var i\n"
+       << "var acc = 0\n"
+       << "onevent ping\n"
+       << "  if args[0] == " << uid << " then\n";
+  if (work) {
+    code << "    for i in 1:" << work << " do\n"
+         << "      acc = acc + i\n"
+         << "    end\n";
+  }
+  code << "    reply[0] = args[1]\n"
+       << "    emit pong reply\n"
+       << "  end\n";
+  return code.str();
+}
+
+static bool load_script(DynamicAsebaNode * node, unsigned work) {
+  auto script = AsebaScript::from_code_string(script_for_node(node->vm.nodeId, work), node->name,
+                                              node->vm.nodeId);
+  script->common_definitions.events.push_back(Aseba::NamedValue(L"ping", 2));
+  script->common_definitions.events.push_back(Aseba::NamedValue(L"pong", 1));
+  return node->load_script(script);
+}
+
+// Messages are (payload size, source, type, payload...), in little-endian words
+static void write_message(Dashel::Stream * stream, uint16_t type,
+                          const std::vector<uint16_t> & payload) {
+  std::vector<uint8_t> buffer(6 + 2 * payload.size());
+  auto put = [&buffer](size_t index, uint16_t value) {
+    buffer[2 * index] = value & 0xff;
+    buffer[2 * index + 1] = value >> 8;
+  };
+  put(0, 2 * payload.size());
+  put(1, 0);
+  put(2, type);
+  for (size_t i = 0; i < payload.size(); i++) put(3 + i, payload[i]);
+  stream->write(buffer.data(), buffer.size());
+  stream->flush();
+}
+
+class BenchClient : public Dashel::Hub {
+ public:
+  // [us]
+  std::vector<double> latencies;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  // not answered before the timeout
+  uint64_t lost = 0;
+
+  BenchClient(const std::map<unsigned, unsigned> & port_of_node, unsigned window,
+              double timeout)
+      : window(window), timeout(timeout) {
+    std::map<unsigned, Dashel::Stream *> streams;
+    for (const auto & [uid, port] : port_of_node) {
+      if (!streams.count(port)) {
+        streams[port] = connect("tcp:host=127.0.0.1;port=" + std::to_string(port));
+      }
+      Node & node = nodes[uid];
+      node.stream = streams[port];
+      node.slots.resize(window);
+      // so that the first ping of slot i has sequence number i
+      for (unsigned i = 0; i < window; i++) node.slots[i].sequence = uint16_t(i - window);
+    }
+  }
+
+  void start() {
+    for (auto & [uid, node] : nodes) {
+      for (auto & slot : node.slots) ping(uid, node, slot);
+    }
+  }
+
+  // Sends again the pings that have not been answered in time
+  void check_timeouts() {
+    const auto now = Clock::now();
+    if (stopping || std::chrono::duration<double>(now - last_check).count() < 0.1 * timeout) {
+      return;
+    }
+    last_check = now;
+    for (auto & [uid, node] : nodes) {
+      for (auto & slot : node.slots) {
+        if (std::chrono::duration<double>(now - slot.sent_at).count() < timeout) continue;
+        lost++;
+        ping(uid, node, slot);
+      }
+    }
+  }
+
+  void stop() { stopping = true; }
+
+ protected:
+  void incomingData(Dashel::Stream * stream) override {
+    uint8_t header[6];
+    stream->read(header, 6);
+    auto get = [](const uint8_t * data) { return uint16_t(data[0] | (data[1] << 8)); };
+    const uint16_t size = get(header);
+    const uint16_t source = get(header + 2);
+    const uint16_t type = get(header + 4);
+    std::vector<uint8_t> payload(size);
+    if (size) stream->read(payload.data(), size);
+    if (type != PONG || size < 2 || !nodes.count(source)) return;
+    const auto now = Clock::now();
+    Node & node = nodes.at(source);
+    const uint16_t sequence = get(payload.data());
+    Slot & slot = node.slots[sequence % window];
+    // answer to a ping that has already been counted as lost
+    if (slot.sequence != sequence) return;
+    latencies.push_back(std::chrono::duration<double, std::micro>(now - slot.sent_at).count());
+    received++;
+    if (!stopping) ping(source, node, slot);
+  }
+
+ private:
+  // an event in flight, with a sequence number equal to its index modulo the window
+  struct Slot {
+    uint16_t sequence;
+    Clock::time_point sent_at;
+  };
+  struct Node {
+    Dashel::Stream * stream;
+    std::vector<Slot> slots;
+  };
+  std::map<unsigned, Node> nodes;
+  unsigned window;
+  // [s]
+  double timeout;
+  Clock::time_point last_check;
+  std::atomic<bool> stopping{false};
+
+  void ping(unsigned uid, Node & node, Slot & slot) {
+    // the window divides 2^16, so the slot stays the same when the sequence number wraps
+    slot.sequence += window;
+    slot.sent_at = Clock::now();
+    write_message(node.stream, PING, {uint16_t(uid), slot.sequence});
+    sent++;
+  }
+};
+
+static double percentile(const std::vector<double> & sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+int main(int argc, char **argv) {
+  unsigned number_of_nodes = 10;
+  unsigned number_of_ports = 1;
+  unsigned first_port = 33400;
+  unsigned window = 1;
+  unsigned work = 0;
+  double timeout = 1000.0;
+  double duration = 5.0;
+  char format[8] = "json";
+  char output[256] = "";
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--nodes=%u", &number_of_nodes)) continue;
+    if (sscanf(argv[i], "--ports=%u", &number_of_ports)) continue;
+    if (sscanf(argv[i], "--port=%u", &first_port)) continue;
+    if (sscanf(argv[i], "--window=%u", &window)) continue;
+    if (sscanf(argv[i], "--work=%u", &work)) continue;
+    if (sscanf(argv[i], "--timeout=%lf", &timeout)) continue;
+    if (sscanf(argv[i], "--duration=%lf", &duration)) continue;
+    if (sscanf(argv[i], "--format=%7s", format)) continue;
+    if (sscanf(argv[i], "--output=%255s", output)) continue;
+    show_usage(argv[0]);
+    return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+  }
+  number_of_ports = std::max(1u, std::min(number_of_ports, number_of_nodes));
+  // a power of two, so that sequence numbers modulo the window do not skip slots when they wrap
+  window = std::clamp(window, 1u, 1024u);
+  while (window & (window - 1)) window++;
+
+  Aseba::set_address("127.0.0.1");
+  Aseba::configure_advertisement(false, false);
+  // uid -> port
+  std::map<unsigned, unsigned> port_of_node;
+  for (unsigned uid = 1; uid <= number_of_nodes; uid++) {
+    const unsigned port = first_port + (uid - 1) % number_of_ports;
+    auto node = Aseba::create_node<DynamicAsebaNode>(uid, port, "node");
+    node->finalize();
+    if (!load_script(node, work)) {
+      std::cerr << "Failed to load the script to node " << uid << std::endl;
+      return 1;
+    }
+    port_of_node[uid] = port;
+  }
+
+  BenchClient * client = nullptr;
+  std::atomic<bool> ready{false};
+  std::atomic<bool> done{false};
+  std::thread client_thread([&]() {
+    try {
+      client = new BenchClient(port_of_node, window, 1e-3 * timeout);
+    } catch (Dashel::DashelException & e) {
+      std::cerr << "Failed to connect: " << e.what() << std::endl;
+      done = true;
+      return;
+    }
+    ready = true;
+    client->start();
+    while (!done) {
+      client->step(1);
+      client->check_timeouts();
+    }
+  });
+  // the networks accept the client connections while spinning
+  while (!ready && !done) Aseba::spin(0);
+
+  const auto start = Clock::now();
+  const double cpu_start = thread_cpu_time();
+  while (!done && std::chrono::duration<double>(Clock::now() - start).count() < duration) {
+    Aseba::spin(0);
+  }
+  const double cpu = thread_cpu_time() - cpu_start;
+  const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  const bool failed = done;
+  if (client) client->stop();
+  done = true;
+  client_thread.join();
+  if (failed) return 1;
+
+  uint64_t instructions = 0;
+  for (const auto & [uid, node] : Aseba::all_nodes()) instructions += node->stats.vm_instructions;
+  std::vector<double> latencies = client->latencies;
+  std::sort(latencies.begin(), latencies.end());
+  const double events_per_second = client->received / elapsed;
+  const double cpu_per_node = 1e6 * cpu / elapsed / number_of_nodes;
+
+  std::ofstream file;
+  if (output[0]) file.open(output);
+  std::ostream & out = output[0] ? file : std::cout;
+  if (strcmp(format, "csv") == 0) {
+    out << "nodes,ports,window,work,duration,events_sent,events_received,events_lost,"
+           "events_per_second,"
+           "latency_p50_us,latency_p90_us,latency_p99_us,latency_max_us,"
+           "cpu_s,cpu_us_per_node_per_s,vm_instructions"
+        << std::endl;
+    out << number_of_nodes << "," << number_of_ports << "," << window << "," << work << ","
+        << elapsed << "," << client->sent << "," << client->received << "," << client->lost
+        << "," << events_per_second << "," << percentile(latencies, 0.5) << ","
+        << percentile(latencies, 0.9) << "," << percentile(latencies, 0.99) << ","
+        << (latencies.empty() ? 0.0 : latencies.back()) << "," << cpu << "," << cpu_per_node
+        << "," << instructions << std::endl;
+  } else {
+    out << "{\"nodes\": " << number_of_nodes << ", \"ports\": " << number_of_ports
+        << ", \"window\": " << window << ", \"work\": " << work << ", \"duration\": " << elapsed
+        << ", \"events_sent\": " << client->sent << ", \"events_received\": " << client->received
+        << ", \"events_lost\": " << client->lost
+        << ", \"events_per_second\": " << events_per_second
+        << ", \"latency_us\": {\"p50\": " << percentile(latencies, 0.5)
+        << ", \"p90\": " << percentile(latencies, 0.9)
+        << ", \"p99\": " << percentile(latencies, 0.99)
+        << ", \"max\": " << (latencies.empty() ? 0.0 : latencies.back()) << "}"
+        << ", \"cpu_s\": " << cpu << ", \"cpu_us_per_node_per_s\": " << cpu_per_node
+        << ", \"vm_instructions\": " << instructions << "}" << std::endl;
+  }
+  delete client;
+  Aseba::remove_all_networks();
+  return 0;
+}
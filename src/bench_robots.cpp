@@ -0,0 +1,211 @@
+// Times the robot models (creation, sensing, LEDs and proximity communication)
+// against the in-memory scene of mock_sim.h, without CoppeliaSim.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "coppeliasim_epuck.h"
+#include "coppeliasim_thymio2.h"
+#include "logging.h"
+#include "mock_sim.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const float TIME_STEP = 0.05f;
+// between neighbors, within the range of proximity sensors and communication [m]
+static const double SPACING = 0.2;
+
+static void show_usage(std::string name) {
+  std::cout << "Usage: " << name << " <option(s)>" << std::endl
+            << "Options:" << std::endl
+            << "  --help\t\t\tShow this help message" << std::endl
+            << "  --robot=<TYPE>\t\tthymio2 or epuck (default: thymio2)" << std::endl
+            << "  --robots=<N,...>\t\tNumbers of robots (default: 10,100,1000)" << std::endl
+            << "  --steps=<STEPS>\t\tSteps per measure (default: 100)" << std::endl
+            << "  --format=<F>\t\tjson or csv (default: json)" << std::endl
+            << "  --output=<PATH>\tWrite the results to a file (default: stdout)" << std::endl;
+}
+
+struct Result {
+  std::string robot;
+  std::string benchmark;
+  unsigned robots;
+  unsigned steps;
+  // [us]
+  double total;
+  double per_robot_step;
+};
+
+template <typename F>
+static double measure(F && f) {
+  const auto start = Clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// Places the robots on a square grid
+template <typename F>
+static std::vector<int> add_robots(unsigned number, F && add) {
+  MockSim::clear();
+  std::vector<int> handles;
+  unsigned side = 1;
+  while (side * side < number) side++;
+  for (unsigned i = 0; i < number; i++) {
+    handles.push_back(add((i % side) * SPACING, (i / side) * SPACING, 0.3 * i));
+  }
+  return handles;
+}
+
+static void bench_thymio2(unsigned number, unsigned steps, std::vector<Result> & results) {
+  const auto handles = add_robots(number, MockSim::add_thymio2);
+  std::map<int, CS::Thymio2> thymios;
+  const double creation = measure([&]() {
+    for (unsigned uid = 0; uid < number; uid++) {
+      thymios.emplace(std::piecewise_construct, std::forward_as_tuple(uid),
+                      std::forward_as_tuple(handles[uid], 0));
+    }
+  });
+  results.push_back({"thymio2", "creation", number, 1, creation, creation / number});
+
+  const double sensing = measure([&]() {
+    for (unsigned step = 0; step < steps; step++) {
+      MockSim::step(TIME_STEP);
+      for (auto & [uid, thymio] : thymios) thymio.update_sensing(TIME_STEP);
+    }
+  });
+  results.push_back({"thymio2", "sensing", number, steps, sensing, sensing / steps / number});
+
+  // one LED of the ring and the top LED change at each step
+  const double leds = measure([&]() {
+    for (unsigned step = 0; step < steps; step++) {
+      for (auto & [uid, thymio] : thymios) {
+        thymio.set_led_intensity(CS::LED::RING_0 + step % 8, (step / 8) % 2);
+        thymio.set_led_color(CS::LED::TOP, false, (step % 3) / 2.0f, 0.5f, 0.0f);
+      }
+    }
+  });
+  results.push_back({"thymio2", "leds", number, steps, leds, leds / steps / number});
+
+  // as in the plugin step
+  std::map<int, int> prox_comm_tx;
+  for (auto & [uid, thymio] : thymios) {
+    thymio.enable_prox_comm(true);
+    thymio.set_prox_comm_tx(uid + 1);
+    prox_comm_tx[uid] = thymio.prox_comm_tx();
+  }
+  size_t messages = 0;
+  const double prox_comm = measure([&]() {
+    for (unsigned step = 0; step < steps; step++) {
+      for (auto & [uid, thymio] : thymios) {
+        thymio.reset_prox_comm_rx();
+        for (const auto & [tid, tx] : prox_comm_tx) {
+          if (uid == tid) continue;
+          thymio.update_prox_comm(thymios.at(tid).prox_comm_emitter_handles(), tx);
+        }
+        messages += thymio.prox_comm_rx().size();
+      }
+    }
+  });
+  results.push_back({"thymio2", "prox_comm", number, steps, prox_comm,
+                     prox_comm / steps / number});
+  if (!messages) std::cerr << "No proximity communication received" << std::endl;
+}
+
+static void bench_epuck(unsigned number, unsigned steps, std::vector<Result> & results) {
+  const auto handles = add_robots(number, MockSim::add_epuck);
+  std::map<int, CS::EPuck> epucks;
+  const double creation = measure([&]() {
+    for (unsigned uid = 0; uid < number; uid++) {
+      epucks.emplace(std::piecewise_construct, std::forward_as_tuple(uid),
+                     std::forward_as_tuple(handles[uid]));
+    }
+  });
+  results.push_back({"epuck", "creation", number, 1, creation, creation / number});
+
+  // including the camera
+  const double sensing = measure([&]() {
+    for (unsigned step = 0; step < steps; step++) {
+      MockSim::step(TIME_STEP);
+      for (auto & [uid, epuck] : epucks) epuck.update_sensing(TIME_STEP);
+    }
+  });
+  results.push_back({"epuck", "sensing", number, steps, sensing, sensing / steps / number});
+
+  const double leds = measure([&]() {
+    for (unsigned step = 0; step < steps; step++) {
+      for (auto & [uid, epuck] : epucks) {
+        epuck.set_ring_led(step % 8, (step / 8) % 2);
+        epuck.set_body_led(step % 2);
+      }
+    }
+  });
+  results.push_back({"epuck", "leds", number, steps, leds, leds / steps / number});
+}
+
+int main(int argc, char **argv) {
+  char robot[16] = "thymio2";
+  char robots[256] = "10,100,1000";
+  unsigned steps = 100;
+  char format[8] = "json";
+  char output[256] = "";
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--robot=%15s", robot)) continue;
+    if (sscanf(argv[i], "--robots=%255s", robots)) continue;
+    if (sscanf(argv[i], "--steps=%u", &steps)) continue;
+    if (sscanf(argv[i], "--format=%7s", format)) continue;
+    if (sscanf(argv[i], "--output=%255s", output)) continue;
+    show_usage(argv[0]);
+    return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+  }
+  const bool thymio2 = strcmp(robot, "thymio2") == 0;
+  if (!thymio2 && strcmp(robot, "epuck") != 0) {
+    show_usage(argv[0]);
+    return 1;
+  }
+  steps = std::max(steps, 1u);
+
+  std::vector<Result> results;
+  std::stringstream numbers(robots);
+  std::string item;
+  while (std::getline(numbers, item, ',')) {
+    const unsigned number = std::stoul(item);
+    if (!number) continue;
+    if (thymio2) {
+      bench_thymio2(number, steps, results);
+    } else {
+      bench_epuck(number, steps, results);
+    }
+  }
+  MockSim::clear();
+
+  std::ofstream file;
+  if (output[0]) file.open(output);
+  std::ostream & out = output[0] ? file : std::cout;
+  if (strcmp(format, "csv") == 0) {
+    out << "robot,benchmark,robots,steps,total_us,us_per_robot_step" << std::endl;
+    for (const auto & r : results) {
+      out << r.robot << "," << r.benchmark << "," << r.robots << "," << r.steps << "," << r.total
+          << "," << r.per_robot_step << std::endl;
+    }
+  } else {
+    out << "[";
+    for (size_t i = 0; i < results.size(); i++) {
+      const auto & r = results[i];
+      out << (i ? ",\n " : "") << "{\"robot\": \"" << r.robot << "\", \"benchmark\": \""
+          << r.benchmark << "\", \"robots\": " << r.robots << ", \"steps\": " << r.steps
+          << ", \"total_us\": " << r.total << ", \"us_per_robot_step\": " << r.per_robot_step
+          << "}";
+    }
+    out << "]" << std::endl;
+  }
+  return 0;
+}
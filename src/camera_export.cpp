@@ -0,0 +1,104 @@
+#include "camera_export.h"
+#include "logging.h"
+
+// Keeps images and cameras aligned to cache lines
+static uint64_t aligned(uint64_t size) {
+  return (size + 63) & ~uint64_t(63);
+}
+
+bool CameraExport::open(const std::string & name, unsigned max_cameras, unsigned depth,
+                        unsigned width, unsigned height) {
+  close();
+  if (!depth) {
+    log_error("Cannot export cameras with no frames");
+    return false;
+  }
+  const uint64_t image_stride = aligned(sizeof(aseba_shm_image_t) + width * height * 3);
+  const uint64_t camera_stride = sizeof(aseba_shm_camera_t) + depth * image_stride;
+  memory = SharedMemory::create(name, sizeof(aseba_shm_cameras_header_t) +
+                                          max_cameras * camera_stride);
+  if (!memory) return false;
+  header = reinterpret_cast<aseba_shm_cameras_header_t *>(memory->data());
+  header->version = ASEBA_SHM_VERSION;
+  header->max_cameras = max_cameras;
+  header->depth = depth;
+  header->width = width;
+  header->height = height;
+  header->image_stride = image_stride;
+  header->camera_stride = camera_stride;
+  for (unsigned i = 0; i < max_cameras; i++) {
+    camera(i)->id = -1;
+  }
+  SharedMemory::fence_release();
+  header->magic = ASEBA_SHM_CAMERAS_MAGIC;
+  log_info("Exporting up to %u cameras to %s (%u frames each)", max_cameras, name.c_str(),
+           depth);
+  return true;
+}
+
+void CameraExport::close() {
+  memory.reset();
+  header = nullptr;
+}
+
+aseba_shm_camera_t * CameraExport::camera(int index) const {
+  if (!header || index < 0 || unsigned(index) >= header->max_cameras) return nullptr;
+  return reinterpret_cast<aseba_shm_camera_t *>(
+      reinterpret_cast<char *>(header + 1) + index * header->camera_stride);
+}
+
+aseba_shm_image_t * CameraExport::image(aseba_shm_camera_t * camera, uint64_t frame) const {
+  return reinterpret_cast<aseba_shm_image_t *>(
+      reinterpret_cast<char *>(camera + 1) + ((frame - 1) % header->depth) * header->image_stride);
+}
+
+size_t CameraExport::frame_size() const {
+  return header ? header->width * header->height * 3 : 0;
+}
+
+int CameraExport::attach(int id) {
+  if (!header) return -1;
+  for (unsigned i = 0; i < header->max_cameras; i++) {
+    aseba_shm_camera_t * c = camera(i);
+    if (c->id == -1) {
+      // NOTE(Jerome): frames keep counting from the previous robot, if any,
+      // so that readers never mistake its frames for new ones
+      c->id = id;
+      return i;
+    }
+  }
+  log_warn("No camera ring left for robot %d", id);
+  return -1;
+}
+
+void CameraExport::detach(int index) {
+  if (aseba_shm_camera_t * c = camera(index)) {
+    c->id = -1;
+  }
+}
+
+uint8_t * CameraExport::begin_frame(int index) {
+  aseba_shm_camera_t * c = camera(index);
+  if (!c) return nullptr;
+  const uint64_t frame = c->frames + 1;
+  SharedMemory::store_release(&c->writing, frame);
+  // the pixels must not be written before readers see `writing`
+  SharedMemory::fence_release();
+  aseba_shm_image_t * i = image(c, frame);
+  i->frame = frame;
+  return reinterpret_cast<uint8_t *>(i + 1);
+}
+
+void CameraExport::end_frame(int index, double time) {
+  aseba_shm_camera_t * c = camera(index);
+  if (!c) return;
+  const uint64_t frame = c->frames + 1;
+  image(c, frame)->time = time;
+  SharedMemory::store_release(&c->frames, frame);
+}
+
+const uint8_t * CameraExport::last_frame(int index) const {
+  aseba_shm_camera_t * c = camera(index);
+  if (!c || !c->frames) return nullptr;
+  return reinterpret_cast<const uint8_t *>(image(c, c->frames) + 1);
+}
@@ -0,0 +1,24 @@
+#include "command_ring.h"
+#include "logging.h"
+
+bool CommandRing::open(const std::string & name, unsigned min_capacity) {
+  close();
+  unsigned size = 1;
+  while (size < min_capacity) size <<= 1;
+  memory = SharedMemory::create(name, sizeof(aseba_shm_ring_header_t) +
+                                          size * sizeof(aseba_shm_command_t));
+  if (!memory) return false;
+  header = reinterpret_cast<aseba_shm_ring_header_t *>(memory->data());
+  header->version = ASEBA_SHM_VERSION;
+  header->capacity = capacity = size;
+  consumed = 0;
+  SharedMemory::fence_release();
+  header->magic = ASEBA_SHM_RING_MAGIC;
+  log_info("Receiving up to %u commands in %s", size, name.c_str());
+  return true;
+}
+
+void CommandRing::close() {
+  memory.reset();
+  header = nullptr;
+}
@@ -0,0 +1,60 @@
+#include "coppeliasim_aseba_node.h"
+#include "aseba_network.h"
+
+DeferredCalls::~DeferredCalls() {
+  if (stack_id >= 0) simReleaseStack(stack_id);
+}
+
+void DeferredCalls::push(LuaFunction & function, const AsebaVMState * vm,
+                         const uint16_t * addresses) {
+  if (function.batch < 0) {
+    auto key = std::make_pair(function.script_id, function.name);
+    auto it = batch_index.find(key);
+    if (it == batch_index.end()) {
+      it = batch_index.emplace(key, batches.size()).first;
+      batches.push_back({function.script_id, function.name, function.argument_sizes,
+                         function.size, {}, {}, {}});
+    }
+    function.batch = it->second;
+  }
+  Batch & batch = batches[function.batch];
+  if (batch.argument_sizes != function.argument_sizes) {
+    log_warn("Cannot defer %s: defined with different arguments", function.name.c_str());
+    return;
+  }
+  batch.ids.push_back(vm->nodeId);
+  for (size_t i = 0; i < batch.argument_sizes.size(); i++) {
+    const int16_t * value = vm->variables + addresses[i];
+    batch.values.insert(batch.values.end(), value, value + batch.argument_sizes[i]);
+    batch.addresses.push_back(addresses[i]);
+  }
+}
+
+void DeferredCalls::flush() {
+  for (Batch & batch : batches) {
+    if (batch.ids.empty()) continue;
+    if (stack_id < 0) stack_id = simCreateStack();
+    simPushInt32TableOntoStack(stack_id, batch.ids.data(), batch.ids.size());
+    simPushInt32TableOntoStack(stack_id, batch.values.data(), batch.values.size());
+    if (simCallScriptFunctionEx(batch.script_id, batch.name.c_str(), stack_id) == -1) {
+      log_warn("Failed to call %s", batch.name.c_str());
+    } else if (simGetStackSize(stack_id) > 0 &&
+               simGetStackTableInfo(stack_id, 0) == int(batch.values.size())) {
+      simGetStackInt32Table(stack_id, batch.values.data(), batch.values.size());
+      const int32_t * value = batch.values.data();
+      const uint16_t * address = batch.addresses.data();
+      for (int id : batch.ids) {
+        DynamicAsebaNode * node = Aseba::node_with_handle(id);
+        for (int size : batch.argument_sizes) {
+          if (node) std::copy_n(value, size, node->vm.variables + *address);
+          value += size;
+          address++;
+        }
+      }
+    }
+    simPopStackItem(stack_id, 0);
+    batch.ids.clear();
+    batch.values.clear();
+    batch.addresses.clear();
+  }
+}
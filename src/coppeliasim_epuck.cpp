@@ -1,5 +1,7 @@
 #include "coppeliasim_epuck.h"
 #include "logging.h"
+#include "profiler.h"
+#include "tracer.h"
 
 #include <math.h>
 
@@ -24,10 +26,27 @@ void Camera::update_sensing(float dt) {
     return;
   }
   unsigned size = width * height * 3;
-  image = std::vector<uint8_t>(buffer, buffer + size);
+  uint8_t * frame = output ? output->begin_frame(channel) : nullptr;
+  if (frame) {
+    std::copy(buffer, buffer + size, frame);
+    output->end_frame(channel, simGetSimulationTime());
+  } else {
+    std::copy(buffer, buffer + size, image.begin());
+  }
   simReleaseBuffer((const char *)buffer);
 }
 
+void Camera::set_output(CameraExport * value, int index) {
+  // keep the last exported frame for Aseba
+  if (output && !value) {
+    if (const uint8_t * frame = output->last_frame(channel)) {
+      std::copy(frame, frame + image.size(), image.begin());
+    }
+  }
+  output = value;
+  channel = index;
+}
+
 void Gyroscope::update_sensing(float dt) {
   if (!active || handle <= 0)
     return;
@@ -54,44 +73,69 @@ static std::array<std::string, 8> proximity_names = {"0", "1", "2", "3",
                                                      "4", "5", "6", "7"};
 static std::array<std::string, 3> ground_names = {"Left", "Center", "Right"};
 
+// The paths of the parts of the model, relative to the model base
+enum {
+  WHEEL_PARTS = 0,
+  PROXIMITY_PARTS = WHEEL_PARTS + 2,
+  ACCELEROMETER_PART = PROXIMITY_PARTS + 8,
+  FORCE_SENSOR_PART,
+  MASS_PART,
+  CAMERA_PART,
+  GYROSCOPE_PART,
+  RING_PART,
+  BODY_PART,
+  REST_PART,
+  FRONT_LED_PART,
+  NUMBER_OF_PARTS
+};
+
+static std::vector<std::string> part_paths() {
+  std::vector<std::string> paths(NUMBER_OF_PARTS);
+  for (size_t i = 0; i < wheel_prefixes.size(); i++) {
+    paths[WHEEL_PARTS + i] = wheel_prefixes[i] + "Motor";
+  }
+  for (size_t i = 0; i < proximity_names.size(); i++) {
+    paths[PROXIMITY_PARTS + i] = "/Proximity_" + proximity_names[i];
+  }
+  paths[ACCELEROMETER_PART] = "/Accelerometer";
+  paths[FORCE_SENSOR_PART] = "/Accelerometer/forceSensor";
+  paths[MASS_PART] = "/Accelerometer/forceSensor/mass";
+  paths[CAMERA_PART] = "/Camera";
+  paths[GYROSCOPE_PART] = "/Gyroscope";
+  paths[RING_PART] = "/Ring";
+  paths[BODY_PART] = "/Body";
+  paths[REST_PART] = "/Rest";
+  paths[FRONT_LED_PART] = "/FrontLed";
+  return paths;
+}
+
 EPuck::EPuck(int handle_)
     : Robot(handle_), front_led(false), body_led(false),
       mic_intensity({0, 0, 0}), battery_voltage(4.0), selector(0), rc(0) {
-  char *alias = simGetObjectAlias(handle, 2);
-  log_info("Initializing EPuck with handle %d (%s)", handle, alias);
-  for (const auto &wheel_prefix : wheel_prefixes) {
-    std::string wheel_path = std::string(alias) + wheel_prefix + "Motor";
-    int wheel_handle = simGetObject(wheel_path.c_str(), -1, -1, 0);
-    wheels.push_back(Wheel(0.0211745, wheel_handle));
+  static const std::vector<std::string> paths = part_paths();
+  const std::vector<int> parts = ModelLayout::resolve(handle, "EPuck", paths);
+  log_info("Initializing EPuck with handle %d", handle);
+  for (size_t i = 0; i < wheel_prefixes.size(); i++) {
+    wheels.push_back(Wheel(0.0211745, parts[WHEEL_PARTS + i]));
   }
-  for (const auto &proximity_name : proximity_names) {
-    std::string prox_path = std::string(alias) + "/Proximity_" + proximity_name;
-    int prox_handle = simGetObject(prox_path.c_str(), -1, -1, 0);
+  for (size_t i = 0; i < proximity_names.size(); i++) {
     proximity_sensors.push_back(
-        ProximitySensor(prox_handle, min_value, max_value, x0, lambda));
+        ProximitySensor(parts[PROXIMITY_PARTS + i], min_value, max_value, x0, lambda));
   }
   // for (const auto & ground_name : ground_names) {
   //   std::string ground_path = std::string(alias)+"/Ground" + ground_name;
   //   int ground_handle = simGetObject(ground_path.c_str(), -1, -1, 0);
   //   ground_sensors.push_back(GroundSensor(ground_handle));
   // }
-  std::string acc_path = std::string(alias) + "/Accelerometer";
-  int acc_handle = simGetObject(acc_path.c_str(), -1, -1, 0);
-  accelerometer = Accelerometer(acc_handle);
-
-  std::string camera_path = std::string(alias) + "/Camera";
-  camera = Camera(simGetObject(camera_path.c_str(), -1, -1, 0));
-
-  gyroscope = Gyroscope(
-      simGetObject((std::string(alias) + "/Gyroscope").c_str(), -1, -1, 0));
-
-  ring_handle = simGetObject((std::string(alias) + "/Ring").c_str(), -1, -1, 0);
-  body_handle = simGetObject((std::string(alias) + "/Body").c_str(), -1, -1, 0);
-  rest_handle = simGetObject((std::string(alias) + "/Rest").c_str(), -1, -1, 0);
-  front_led_handle =
-      simGetObject((std::string(alias) + "/FrontLed").c_str(), -1, -1, 0);
+  accelerometer =
+      Accelerometer(parts[ACCELEROMETER_PART], parts[FORCE_SENSOR_PART], parts[MASS_PART]);
+  camera = Camera(parts[CAMERA_PART]);
+  gyroscope = Gyroscope(parts[GYROSCOPE_PART]);
+  ring_handle = parts[RING_PART];
+  body_handle = parts[BODY_PART];
+  rest_handle = parts[REST_PART];
+  front_led_handle = parts[FRONT_LED_PART];
   leds = LEDRing(ring_handle);
-  simReleaseBuffer(alias);
   reset();
 }
 
@@ -144,8 +188,9 @@ LEDRing::LEDRing(int shape_handle_) : shape_handle(shape_handle_) {
   if (shape_handle <= 0)
     return;
   texture_id = simGetShapeTextureId(shape_handle);
-  log_info("loading led texture");
-  texture = cv::imread(Robot::get_texture_path("epuck.png").string());
+  // loaded once for all robots
+  static const cv::Mat ring_texture = cv::imread(Robot::get_texture_path("epuck.png").string());
+  texture = ring_texture.clone();
   int64 uid = simGetObjectUid(shape_handle);
   // HACK(Jerome): One pixel should be specific to each robot,
   // else coppeliaSim will link them when it save the scene
@@ -254,6 +299,8 @@ LEDRing::LED::LED(int position, const cv::Mat &texture)
 }
 
 void LEDRing::LED::push(int texture_id, int texture_size) {
+  PROFILE_SCOPE(TEXTURES);
+  TRACE_SCOPE("simWriteTexture", texture_id, position);
   const char *patch =
       (const char *)(value ? on_texture : off_texture).ptr<uint8_t>();
   simWriteTexture(texture_id, 0, patch, position,
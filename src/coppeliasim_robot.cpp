@@ -2,6 +2,7 @@
 #include "logging.h"
 
 #include <math.h>
+#include <algorithm>
 
 #define G 9.81f
 
@@ -19,6 +20,65 @@ static float normalize_angle(float angle) {
 
 namespace CS {
 
+// Whether the path of object `handle` ends with `suffix`
+static bool has_path(int handle, const std::string & suffix) {
+  char * path = simGetObjectAlias(handle, 2);
+  if (!path) return false;
+  const std::string p(path);
+  simReleaseBuffer(path);
+  return p.size() >= suffix.size() && !p.compare(p.size() - suffix.size(), suffix.size(), suffix);
+}
+
+std::vector<int> ModelLayout::resolve(int handle, const std::string & model,
+                                      const std::vector<std::string> & paths) {
+  std::vector<int> handles(paths.size(), -1);
+  int tree_size = 0;
+  int * tree = simGetObjectsInTree(handle, sim_handle_all, 0, &tree_size);
+  if (!tree) {
+    log_error("Cannot get the objects of model %d", handle);
+    return handles;
+  }
+  // instances of the same model share their alias (without index) and size
+  char * name = simGetObjectAlias(handle, 0);
+  const Key key{model, name ? name : "", tree_size};
+  if (name) simReleaseBuffer(name);
+  auto it = templates.find(key);
+  if (it != templates.end()) {
+    const Template & t = it->second;
+    bool valid = true;
+    for (size_t i = 0; i < paths.size() && valid; i++) {
+      if (t.indices[i] < 0) continue;
+      handles[i] = tree[t.indices[i]];
+      // parts of the same type may have been reordered
+      valid = simGetObjectType(handles[i]) == t.types[i] && has_path(handles[i], paths[i]);
+    }
+    if (valid) {
+      simReleaseBuffer((char *)tree);
+      return handles;
+    }
+    log_warn("Model %d does not match the layout of %s: resolving it by path", handle,
+             model.c_str());
+  }
+  char * alias = simGetObjectAlias(handle, 2);
+  const std::string base = std::string(alias);
+  simReleaseBuffer(alias);
+  std::map<int, int> index_of;
+  for (int i = 0; i < tree_size; i++) {
+    index_of[tree[i]] = i;
+  }
+  simReleaseBuffer((char *)tree);
+  Template t{std::vector<int>(paths.size(), -1), std::vector<int>(paths.size(), -1)};
+  for (size_t i = 0; i < paths.size(); i++) {
+    handles[i] = simGetObject((base + paths[i]).c_str(), -1, -1, 0);
+    if (handles[i] >= 0 && index_of.count(handles[i])) {
+      t.indices[i] = index_of.at(handles[i]);
+      t.types[i] = simGetObjectType(handles[i]);
+    }
+  }
+  templates[key] = t;
+  return handles;
+}
+
 Robot::Robot(int handle_) : handle(handle_), wheels(), proximity_sensors(), ground_sensors() { }
 
 Robot::~Robot() { }
@@ -44,6 +104,43 @@ float Robot::get_target_speed(size_t index) {
   return 0.0;
 }
 
+size_t Robot::observations_size(unsigned fields) const {
+  size_t size = 0;
+  if (fields & OBSERVATION_SPEED) size += wheels.size();
+  if (fields & OBSERVATION_PROXIMITY) size += proximity_sensors.size();
+  if (fields & OBSERVATION_GROUND) size += ground_sensors.size();
+  if (fields & OBSERVATION_ACCELERATION) size += 3;
+  if (fields & OBSERVATION_ODOMETRY) size += wheels.size();
+  return size;
+}
+
+float * Robot::write_observations(unsigned fields, float * buffer) const {
+  if (fields & OBSERVATION_SPEED) {
+    for (const auto & wheel : wheels) *buffer++ = wheel.speed();
+  }
+  if (fields & OBSERVATION_PROXIMITY) {
+    for (const auto & prox : proximity_sensors) *buffer++ = prox.saturated_value();
+  }
+  if (fields & OBSERVATION_GROUND) {
+    for (const auto & ground : ground_sensors) *buffer++ = ground.reflected_light;
+  }
+  if (fields & OBSERVATION_ACCELERATION) {
+    buffer = std::copy(accelerometer.values, accelerometer.values + 3, buffer);
+  }
+  if (fields & OBSERVATION_ODOMETRY) {
+    for (const auto & wheel : wheels) *buffer++ = wheel.odometry;
+  }
+  return buffer;
+}
+
+void Robot::get_pose(float position[3], float orientation[3]) const {
+  simFloat values[3];
+  simGetObjectPosition(handle, -1, values);
+  std::copy(values, values + 3, position);
+  simGetObjectOrientation(handle, -1, values);
+  std::copy(values, values + 3, orientation);
+}
+
 void Robot::update_sensing(float dt) {
   for (auto & wheel : wheels) {
     wheel.update_sensing(dt);
@@ -185,16 +282,9 @@ void ProximitySensor::update_sensing(float dt) {
   }
 }
 
-GroundSensor::GroundSensor(int handle_) :
+GroundSensor::GroundSensor(int handle_, int vision_handle_) :
   handle(handle_), active(true), only_red(false), use_vision(false),
-  max_value(default_max_value), x0(default_x0) {
-  if (handle >= 0) {
-    char * alias = simGetObjectAlias(handle, 2);
-    std::string path = std::string(alias);
-    simReleaseBuffer(alias);
-    vision_handle = simGetObject((path + "/Vision").c_str(), -1, -1, 0);
-  }
-}
+  max_value(default_max_value), x0(default_x0), vision_handle(vision_handle_) { }
 
 // static float ground_response(
 //     float distance, float normal, float value,
@@ -270,16 +360,12 @@ void GroundSensor::update_sensing(float dt) {
   }
 }
 
-Accelerometer::Accelerometer(int handle_) : handle(handle_), active(true) {
+Accelerometer::Accelerometer(int handle_, int sensor_, int mass_handle) :
+  handle(handle_), active(true), mass(0), sensor(sensor_) {
   if (handle >= 0) {
-    char * alias = simGetObjectAlias(handle, 2);
-    std::string path = std::string(alias);
-    simReleaseBuffer(alias);
-    int massObject = simGetObject((path + "/forceSensor/mass").c_str(), -1, -1, 0);
-    sensor = simGetObject((path + "/forceSensor").c_str(), -1, -1, 0);
-    int r = simGetObjectFloatParam(massObject, sim_shapefloatparam_mass, &mass);
+    int r = simGetObjectFloatParam(mass_handle, sim_shapefloatparam_mass, &mass);
     if (r != 1) {
-      log_error("Error %d getting mass of object %d", r, massObject);
+      log_error("Error %d getting mass of object %d", r, mass_handle);
     }
   }
 }
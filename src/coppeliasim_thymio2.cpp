@@ -1,5 +1,7 @@
 #include "coppeliasim_thymio2.h"
 #include "logging.h"
+#include "profiler.h"
+#include "tracer.h"
 
 #include <math.h>
 
@@ -8,6 +10,9 @@
 #define TEXTURE_SIZE 1024
 
 static cv::Mat body_texture;
+// body texture converted once for all robots: RGB and RGB flipped vertically (as loaded in CoppeliaSim)
+static cv::Mat body_texture_rgb;
+static cv::Mat body_texture_rgb_flipped;
 static std::array<cv::Mat, 3> led_texture_images;
 static bool loaded_textures = false;
 
@@ -140,7 +145,6 @@ private:
       } else if (index < 0) {
         index += 8;
       }
-      printf("A %d \n", index);
       robot.set_led_intensity(LED::RING_0 + index, intensity);
       acc_previous_led = index;
     }
@@ -395,6 +399,8 @@ static void load_textures() {
   led_texture_images[LED_TEXTURE] = cv::imread(
       Robot::get_texture_path("thymio-body-diffusionMap2.png").string(),
       cv::IMREAD_UNCHANGED);
+  cv::cvtColor(body_texture, body_texture_rgb, cv::COLOR_BGR2RGB);
+  cv::flip(body_texture_rgb, body_texture_rgb_flipped, 0);
   loaded_textures = true;
 }
 
@@ -409,40 +415,71 @@ static std::array<std::string, 2> ground_names = {"Left", "Right"};
 static std::array<std::string, Button::COUNT> button_names = {
     "Backward", "Left", "Center", "Forward", "Right"};
 
+// The paths of the parts of the model, relative to the model base
+enum {
+  BODY_PART = 0,
+  WHEEL_PARTS = BODY_PART + 1,
+  PROXIMITY_PARTS = WHEEL_PARTS + 2,
+  COMM_PARTS = PROXIMITY_PARTS + 7,
+  GROUND_PARTS = COMM_PARTS + 7,
+  GROUND_VISION_PARTS = GROUND_PARTS + 2,
+  ACCELEROMETER_PART = GROUND_VISION_PARTS + 2,
+  FORCE_SENSOR_PART,
+  MASS_PART,
+  BUTTON_PARTS,
+  NUMBER_OF_PARTS = BUTTON_PARTS + Button::COUNT
+};
+
+static std::vector<std::string> part_paths() {
+  std::vector<std::string> paths(NUMBER_OF_PARTS);
+  paths[BODY_PART] = "/Body";
+  for (size_t i = 0; i < wheel_prefixes.size(); i++) {
+    paths[WHEEL_PARTS + i] = wheel_prefixes[i] + "Motor";
+  }
+  for (size_t i = 0; i < proximity_names.size(); i++) {
+    paths[PROXIMITY_PARTS + i] = "/Proximity" + proximity_names[i];
+    paths[COMM_PARTS + i] = "/Proximity" + proximity_names[i] + "/Comm";
+  }
+  for (size_t i = 0; i < ground_names.size(); i++) {
+    paths[GROUND_PARTS + i] = "/Ground" + ground_names[i];
+    paths[GROUND_VISION_PARTS + i] = "/Ground" + ground_names[i] + "/Vision";
+  }
+  paths[ACCELEROMETER_PART] = "/Accelerometer";
+  paths[FORCE_SENSOR_PART] = "/Accelerometer/forceSensor";
+  paths[MASS_PART] = "/Accelerometer/forceSensor/mass";
+  for (size_t i = 0; i < button_names.size(); i++) {
+    paths[BUTTON_PARTS + i] = "/Button" + button_names[i];
+  }
+  return paths;
+}
+
 Thymio2::Thymio2(int handle_, uint8_t default_behavior_mask_)
     : Robot(handle_), default_behavior_mask(default_behavior_mask_),
       behavior(new Behavior(*this, default_behavior_mask_)),
       battery_voltage(3.61), temperature(22.0), mic_intesity(0.0),
       mic_threshold(0.0), r5(false), sd_card() {
-  char *alias = simGetObjectAlias(handle, 2);
-  std::string body_path = std::string(alias) + "/Body";
-  body_handle = simGetObject(body_path.c_str(), -1, -1, 0);
+  static const std::vector<std::string> paths = part_paths();
+  const std::vector<int> parts = ModelLayout::resolve(handle, "Thymio2", paths);
+  body_handle = parts[BODY_PART];
   texture_id = simGetShapeTextureId(body_handle);
   log_info("Initializing Thymio2 with handle %d and texture_id %d", handle,
            texture_id);
-  for (const auto &wheel_prefix : wheel_prefixes) {
-    std::string wheel_path = std::string(alias) + wheel_prefix + "Motor";
-    int wheel_handle = simGetObject(wheel_path.c_str(), -1, -1, 0);
-    wheels.push_back(Wheel(0.022, wheel_handle));
+  for (size_t i = 0; i < wheel_prefixes.size(); i++) {
+    wheels.push_back(Wheel(0.022, parts[WHEEL_PARTS + i]));
   }
   for (size_t i = 0; i < proximity_names.size(); i++) {
-    std::string prox_path =
-        std::string(alias) + "/Proximity" + proximity_names[i];
-    int prox_handle = simGetObject(prox_path.c_str(), -1, -1, 0);
+    int prox_handle = parts[PROXIMITY_PARTS + i];
     proximity_sensors.push_back(ProximitySensor(
         prox_handle, proximity_min_value, proximity_max_value, x0, lambda));
     prox_comm.emitter_handles[i] = prox_handle;
-    prox_comm.sensor_handles[i] =
-        simGetObject((prox_path + "/Comm").c_str(), -1, -1, 0);
+    prox_comm.sensor_handles[i] = parts[COMM_PARTS + i];
   }
-  for (const auto &ground_name : ground_names) {
-    std::string ground_path = std::string(alias) + "/Ground" + ground_name;
-    int ground_handle = simGetObject(ground_path.c_str(), -1, -1, 0);
-    ground_sensors.push_back(GroundSensor(ground_handle));
+  for (size_t i = 0; i < ground_names.size(); i++) {
+    ground_sensors.push_back(
+        GroundSensor(parts[GROUND_PARTS + i], parts[GROUND_VISION_PARTS + i]));
   }
-  std::string acc_path = std::string(alias) + "/Accelerometer";
-  int acc_handle = simGetObject(acc_path.c_str(), -1, -1, 0);
-  accelerometer = Accelerometer(acc_handle);
+  accelerometer =
+      Accelerometer(parts[ACCELEROMETER_PART], parts[FORCE_SENSOR_PART], parts[MASS_PART]);
   for (size_t i = LED::BUTTON_UP; i <= LED::BUTTON_RIGHT; i++) {
     leds[i].color = Color(1, 0, 0);
   }
@@ -463,12 +500,8 @@ Thymio2::Thymio2(int handle_, uint8_t default_behavior_mask_)
   }
 
   for (size_t i = 0; i < buttons.size(); i++) {
-    std::string button_path = std::string(alias) + "/Button" + button_names[i];
-    int button_handle = simGetObject(button_path.c_str(), -1, -1, 0);
-    buttons[i] = Button(button_handle);
+    buttons[i] = Button(parts[BUTTON_PARTS + i]);
   }
-
-  simReleaseBuffer(alias);
   reset();
 }
 
@@ -480,10 +513,8 @@ void Thymio2::enable_behavior(bool value, uint8_t mask) {
 
 void Thymio2::reset_texture(bool reload) {
   load_textures();
-  texture = cv::Mat(TEXTURE_SIZE, TEXTURE_SIZE, CV_8UC3);
-  cv::cvtColor(body_texture, texture, cv::COLOR_BGR2RGB);
-  cv::Mat m = cv::Mat(TEXTURE_SIZE, TEXTURE_SIZE, CV_8UC3);
-  cv::flip(texture, m, 0);
+  body_texture_rgb.copyTo(texture);
+  cv::Mat m = body_texture_rgb_flipped.clone();
   int64 uid = simGetObjectUid(handle);
   // HACK(Jerome): One pixel should be specific to each robot,
   // else coppeliaSim will link them when it save the scene
@@ -623,6 +654,8 @@ void Thymio2::set_led_color(size_t index, bool force, float r, float g,
   } else {
     base_image = texture.ptr<uint8_t>();
   }
+  PROFILE_SCOPE(TEXTURES);
+  TRACE_SCOPE("simWriteTexture", texture_id, index);
   for (auto &a : led_texture.regions) {
     uint8_t *roi = (uint8_t *)malloc(a.h * a.w * 3);
     draw_rect(roi, base_image, led_image, TEXTURE_SIZE, a.x, a.y, a.w, a.h,
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+
+namespace {
+
+using Logging::Message;
+
+const char * level_name(int verbosity) {
+  if (verbosity <= sim_verbosity_errors) return "error";
+  if (verbosity <= sim_verbosity_warnings) return "warning";
+  if (verbosity <= sim_verbosity_infos) return "info";
+  return "debug";
+}
+
+std::mutex mutex;
+std::condition_variable wake_up;
+std::vector<Message> queue;
+// `queued` and `file` are only changed by `configure`, while holding `mutex`
+std::atomic<bool> queued{false};
+FILE * file = nullptr;
+std::thread writer;
+bool stopping = false;
+// the only thread allowed to call CoppeliaSim, set by `refresh_verbosity`
+std::atomic<std::thread::id> simulation_thread;
+thread_local std::vector<Message> * captured = nullptr;
+
+// Writes the queued messages to the file in batches, outside of the lock
+void write_to_file() {
+  std::vector<Message> batch;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wake_up.wait(lock, [] { return stopping || !queue.empty(); });
+    if (queue.empty() && stopping) break;
+    batch.swap(queue);
+    lock.unlock();
+    const std::time_t now = std::time(nullptr);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    for (const auto & message : batch) {
+      std::fprintf(file, "%s [%s] %s\n", stamp, level_name(message.verbosity),
+                   message.text.c_str());
+    }
+    std::fflush(file);
+    batch.clear();
+    lock.lock();
+  }
+}
+
+void stop_writer() {
+  if (!writer.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake_up.notify_one();
+  writer.join();
+  stopping = false;
+}
+
+}  // namespace
+
+namespace Logging {
+
+void refresh_verbosity() {
+  simulation_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+  int console = sim_verbosity_debug;
+  int status_bar = sim_verbosity_none;
+  simGetModuleInfo(PLUGIN_NAME_XML, sim_moduleinfo_verbosity, nullptr, &console);
+  simGetModuleInfo(PLUGIN_NAME_XML, sim_moduleinfo_statusbarverbosity, nullptr, &status_bar);
+  // NOTE(Jerome): a file sink gets everything that is compiled in
+  int value = std::max(console, status_bar);
+  if (file) value = sim_verbosity_debug;
+  verbosity.store(value, std::memory_order_relaxed);
+}
+
+bool configure(const std::string & path, bool asynchronous) {
+  stop_writer();
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file) {
+      std::fclose(file);
+      file = nullptr;
+    }
+    queued = false;
+  }
+  if (!path.empty()) {
+    FILE * f = std::fopen(path.c_str(), "a");
+    if (!f) {
+      log_error("Failed to open log file %s", path.c_str());
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    file = f;
+    queued = true;
+    writer = std::thread(write_to_file);
+  } else {
+    queued = asynchronous;
+  }
+  refresh_verbosity();
+  return true;
+}
+
+void write(int verbosity, std::string && message) {
+  if (captured) {
+    captured->push_back({verbosity, std::move(message)});
+    return;
+  }
+  // messages from other threads (e.g., the network I/O thread) wait for `flush`
+  if (!queued.load(std::memory_order_relaxed) &&
+      std::this_thread::get_id() == simulation_thread.load(std::memory_order_relaxed)) {
+    simAddLog(PLUGIN_NAME_XML, verbosity, message.c_str());
+    return;
+  }
+  bool notify;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    notify = file && queue.empty();
+    queue.push_back({verbosity, std::move(message)});
+  }
+  if (notify) wake_up.notify_one();
+}
+
+void flush() {
+  std::vector<Message> batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file) return;
+    batch.swap(queue);
+  }
+  for (const auto & message : batch) {
+    simAddLog(PLUGIN_NAME_XML, message.verbosity, message.text.c_str());
+  }
+}
+
+Capture::Capture(std::vector<Message> & messages) : previous(captured) {
+  captured = &messages;
+}
+
+Capture::~Capture() {
+  captured = previous;
+}
+
+}  // namespace Logging
@@ -0,0 +1,655 @@
+// Implements the subset of the CoppeliaSim API used by the robot models
+// against the in-memory scene of mock_sim.h. It takes the place of the CoppeliaSim
+// library: the plugin accesses the API through the function pointers declared in simLib.h,
+// which are defined here.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <simPlusPlus/Lib.h>
+
+#include "mock_sim.h"
+
+namespace {
+
+// 3 x 4 row-major, as in CoppeliaSim
+struct Pose {
+  double m[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+
+  static Pose from(double x, double y, double z, double yaw) {
+    const double c = cos(yaw), s = sin(yaw);
+    return Pose{{c, -s, 0, x, s, c, 0, y, 0, 0, 1, z}};
+  }
+
+  // with the z-axis along `direction` (a unit vector)
+  static Pose pointing(double x, double y, double z, const double direction[3]) {
+    // any x-axis orthogonal to the z-axis
+    double a[3] = {direction[2], 0, -direction[0]};
+    if (std::abs(direction[1]) > 0.9) {
+      a[0] = 0;
+      a[1] = direction[2];
+      a[2] = -direction[1];
+    }
+    const double n = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    const double * z_ = direction;
+    const double x_[3] = {a[0] / n, a[1] / n, a[2] / n};
+    const double y_[3] = {z_[1] * x_[2] - z_[2] * x_[1], z_[2] * x_[0] - z_[0] * x_[2],
+                          z_[0] * x_[1] - z_[1] * x_[0]};
+    return Pose{{x_[0], y_[0], z_[0], x, x_[1], y_[1], z_[1], y, x_[2], y_[2], z_[2], z}};
+  }
+
+  Pose operator*(const Pose & o) const {
+    Pose r;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 4; j++) {
+        r.m[4 * i + j] = m[4 * i] * o.m[j] + m[4 * i + 1] * o.m[4 + j] + m[4 * i + 2] * o.m[8 + j] +
+                         (j == 3 ? m[4 * i + 3] : 0.0);
+      }
+    }
+    return r;
+  }
+
+  Pose inverse() const {
+    Pose r;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) r.m[4 * i + j] = m[4 * j + i];
+      r.m[4 * i + 3] = -(m[i] * m[3] + m[4 + i] * m[7] + m[8 + i] * m[11]);
+    }
+    return r;
+  }
+
+  void apply(const double v[3], double r[3]) const {
+    for (int i = 0; i < 3; i++) {
+      r[i] = m[4 * i] * v[0] + m[4 * i + 1] * v[1] + m[4 * i + 2] * v[2] + m[4 * i + 3];
+    }
+  }
+
+  void rotate(const double v[3], double r[3]) const {
+    for (int i = 0; i < 3; i++) {
+      r[i] = m[4 * i] * v[0] + m[4 * i + 1] * v[1] + m[4 * i + 2] * v[2];
+    }
+  }
+};
+
+struct Object {
+  std::string path;
+  int type;
+  int parent;
+  // the base of the robot
+  int model;
+  std::vector<int> children;
+  Pose local;
+  Pose world;
+  float color[3] = {1, 1, 1};
+  float emission[3] = {0, 0, 0};
+  int texture = -1;
+  // joints
+  double velocity = 0;
+  double position = 0;
+  // shapes
+  double mass = 0;
+  // proximity sensors
+  double range = 0;
+  // vision sensors
+  int resolution[2] = {0, 0};
+};
+
+struct Texture {
+  int width;
+  int height;
+  std::vector<uint8_t> data;
+};
+
+// Robots bodies, indexed on a grid to limit the number of intersections per ray
+struct Body {
+  int handle;
+  int model;
+  double center[3];
+  double radius;
+};
+
+const double CELL_SIZE = 0.5;
+const double FLOOR_COLOR[3] = {0.8, 0.8, 0.8};
+
+struct Scene {
+  std::vector<Object> objects;
+  std::map<std::string, int> handles;
+  std::vector<Texture> textures;
+  std::vector<Body> bodies;
+  std::unordered_map<int64_t, std::vector<int>> cells;
+  double max_radius = 0;
+  double time = 0;
+  int floor = -1;
+  // shared by all shapes of the same model until a texture is applied
+  std::map<std::pair<int, int>, int> model_textures;
+  std::string model_path =
+#ifdef MOCK_SIM_MODEL_PATH
+      MOCK_SIM_MODEL_PATH;
+#else
+      ".";
+#endif
+};
+
+Scene scene;
+
+int64_t cell_key(int64_t i, int64_t j) { return (i << 32) ^ (j & 0xffffffff); }
+
+int64_t cell_index(double value) { return int64_t(std::floor(value / CELL_SIZE)); }
+
+bool valid(int handle) { return handle >= 0 && handle < int(scene.objects.size()); }
+
+void update_world(int handle) {
+  Object & object = scene.objects[handle];
+  object.world =
+      object.parent >= 0 ? scene.objects[object.parent].world * object.local : object.local;
+  for (int child : object.children) update_world(child);
+}
+
+int add_object(const std::string & path, int type, int parent, const Pose & local) {
+  const int handle = int(scene.objects.size());
+  Object object;
+  object.path = path;
+  object.type = type;
+  object.parent = parent;
+  object.model = parent >= 0 ? scene.objects[parent].model : handle;
+  object.local = local;
+  scene.objects.push_back(object);
+  scene.handles[path] = handle;
+  if (parent >= 0) scene.objects[parent].children.push_back(handle);
+  update_world(handle);
+  return handle;
+}
+
+int add_texture(int width, int height) {
+  scene.textures.push_back({width, height, std::vector<uint8_t>(size_t(width) * height * 3, 128)});
+  return int(scene.textures.size()) - 1;
+}
+
+int model_texture(int kind, int part) {
+  auto key = std::make_pair(kind, part);
+  auto it = scene.model_textures.find(key);
+  if (it != scene.model_textures.end()) return it->second;
+  return scene.model_textures[key] = add_texture(1024, 1024);
+}
+
+void add_body(int handle, double height, double radius) {
+  const Object & object = scene.objects[handle];
+  Body body{handle, object.model, {object.world.m[3], object.world.m[7], height}, radius};
+  scene.cells[cell_key(cell_index(body.center[0]), cell_index(body.center[1]))].push_back(
+      int(scene.bodies.size()));
+  scene.bodies.push_back(body);
+  scene.max_radius = std::max(scene.max_radius, radius);
+}
+
+std::string unique_name(const std::string & name) {
+  std::string path = "/" + name;
+  for (int i = 0; scene.handles.count(path); i++) {
+    path = "/" + name + "[" + std::to_string(i) + "]";
+  }
+  return path;
+}
+
+int add_sensor(const std::string & path, int parent, double x, double y, double z,
+               double angle, double range) {
+  const double direction[3] = {cos(angle), sin(angle), 0};
+  int handle = add_object(path, sim_object_proximitysensor_type, parent,
+                          Pose::pointing(x, y, z, direction));
+  scene.objects[handle].range = range;
+  return handle;
+}
+
+int add_ground_sensor(const std::string & path, int parent, double x, double y) {
+  const double down[3] = {0, 0, -1};
+  int handle = add_object(path, sim_object_proximitysensor_type, parent,
+                          Pose::pointing(x, y, 0.01, down));
+  scene.objects[handle].range = 0.03;
+  return handle;
+}
+
+void add_accelerometer(const std::string & base, int parent, double mass) {
+  int accelerometer = add_object(base + "/Accelerometer", sim_object_dummy_type, parent, Pose());
+  int force_sensor = add_object(base + "/Accelerometer/forceSensor", sim_object_forcesensor_type,
+                                accelerometer, Pose());
+  int m = add_object(base + "/Accelerometer/forceSensor/mass", sim_object_shape_type,
+                     force_sensor, Pose());
+  scene.objects[m].mass = mass;
+}
+
+// Ray along the z-axis of a sensor
+int detect(int sensor, double max_distance, double point[4], int * detected, double normal[3]) {
+  const Object & object = scene.objects[sensor];
+  const Pose & pose = object.world;
+  const double o[3] = {pose.m[3], pose.m[7], pose.m[11]};
+  const double d[3] = {pose.m[2], pose.m[6], pose.m[10]};
+  double best = max_distance;
+  int hit = -1;
+  double n[3] = {0, 0, 0};
+  if (d[2] < 0 && o[2] >= 0) {
+    const double t = -o[2] / d[2];
+    if (t <= best) {
+      best = t;
+      hit = scene.floor;
+      n[2] = 1;
+    }
+  }
+  const double reach = max_distance + scene.max_radius;
+  for (int64_t i = cell_index(o[0] - reach); i <= cell_index(o[0] + reach); i++) {
+    for (int64_t j = cell_index(o[1] - reach); j <= cell_index(o[1] + reach); j++) {
+      auto it = scene.cells.find(cell_key(i, j));
+      if (it == scene.cells.end()) continue;
+      for (int index : it->second) {
+        const Body & body = scene.bodies[index];
+        if (body.model == object.model) continue;
+        const double oc[3] = {o[0] - body.center[0], o[1] - body.center[1],
+                              o[2] - body.center[2]};
+        const double b = oc[0] * d[0] + oc[1] * d[1] + oc[2] * d[2];
+        const double c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - body.radius * body.radius;
+        const double disc = b * b - c;
+        if (c <= 0 || disc < 0) continue;
+        const double t = -b - sqrt(disc);
+        if (t < 0 || t > best) continue;
+        best = t;
+        hit = body.handle;
+        for (int k = 0; k < 3; k++) n[k] = (oc[k] + t * d[k]) / body.radius;
+      }
+    }
+  }
+  if (hit < 0) return 0;
+  if (point) {
+    point[0] = point[1] = 0;
+    point[2] = point[3] = best;
+  }
+  if (detected) *detected = hit;
+  if (normal) pose.inverse().rotate(n, normal);
+  return 1;
+}
+
+Pose relative_pose(int handle, int relative_to) {
+  const Pose & pose = scene.objects[handle].world;
+  if (relative_to < 0 || !valid(relative_to)) return pose;
+  return scene.objects[relative_to].world.inverse() * pose;
+}
+
+template <typename T>
+T * allocate(size_t size) {
+  return static_cast<T *>(calloc(size ? size : 1, sizeof(T)));
+}
+
+char * copy_string(const std::string & value) {
+  char * buffer = allocate<char>(value.size() + 1);
+  memcpy(buffer, value.c_str(), value.size());
+  return buffer;
+}
+
+/* API */
+
+int release_buffer(const void * buffer) {
+  free(const_cast<void *>(buffer));
+  return 1;
+}
+
+int get_object(const char * path, int index, int proxy, int options) {
+  auto it = scene.handles.find(path);
+  return it == scene.handles.end() ? -1 : it->second;
+}
+
+long long int get_object_uid(int handle) { return valid(handle) ? 1000 + handle : -1; }
+
+char * get_object_alias(int handle, int options) {
+  if (!valid(handle)) return nullptr;
+  const std::string & path = scene.objects[handle].path;
+  if (options != 0) return copy_string(path);
+  // the alias only, without index
+  const std::string alias = path.substr(path.rfind('/') + 1);
+  return copy_string(alias.substr(0, alias.find('[')));
+}
+
+int get_object_type(int handle) { return valid(handle) ? scene.objects[handle].type : -1; }
+
+void collect_tree(int handle, std::vector<int> & tree) {
+  tree.push_back(handle);
+  for (int child : scene.objects[handle].children) collect_tree(child, tree);
+}
+
+int * get_objects_in_tree(int handle, int type, int options, int * count) {
+  if (!valid(handle)) return nullptr;
+  std::vector<int> tree;
+  collect_tree(handle, tree);
+  int * buffer = allocate<int>(tree.size());
+  std::copy(tree.begin(), tree.end(), buffer);
+  *count = int(tree.size());
+  return buffer;
+}
+
+int get_object_position(int handle, int relative_to, double * position) {
+  if (!valid(handle)) return -1;
+  const Pose pose = relative_pose(handle, relative_to);
+  position[0] = pose.m[3];
+  position[1] = pose.m[7];
+  position[2] = pose.m[11];
+  return 1;
+}
+
+// alpha, beta, gamma such that R = Rx(alpha) Ry(beta) Rz(gamma)
+int get_object_orientation(int handle, int relative_to, double * angles) {
+  if (!valid(handle)) return -1;
+  const Pose pose = relative_pose(handle, relative_to);
+  const double * m = pose.m;
+  angles[0] = atan2(-m[6], m[10]);
+  angles[1] = asin(std::clamp(m[2], -1.0, 1.0));
+  angles[2] = atan2(-m[1], m[0]);
+  return 1;
+}
+
+int get_object_matrix(int handle, int relative_to, double * matrix) {
+  if (!valid(handle)) return -1;
+  const Pose pose = relative_pose(handle, relative_to);
+  std::copy(pose.m, pose.m + 12, matrix);
+  return 1;
+}
+
+// (x, y, z, w)
+int set_object_quaternion(int handle, int relative_to, const double * q) {
+  if (!valid(handle)) return -1;
+  const double x = q[0], y = q[1], z = q[2], w = q[3];
+  Pose rotation{{1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w), 0,
+                 2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w), 0,
+                 2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y), 0}};
+  Object & object = scene.objects[handle];
+  Pose world = valid(relative_to) ? scene.objects[relative_to].world * rotation : rotation;
+  world.m[3] = object.world.m[3];
+  world.m[7] = object.world.m[7];
+  world.m[11] = object.world.m[11];
+  object.local = object.parent >= 0 ? scene.objects[object.parent].world.inverse() * world : world;
+  update_world(handle);
+  return 1;
+}
+
+int get_object_velocity(int handle, double * linear, double * angular) {
+  if (linear) std::fill(linear, linear + 3, 0.0);
+  if (angular) std::fill(angular, angular + 3, 0.0);
+  return 1;
+}
+
+int invert_matrix(double * matrix) {
+  Pose pose;
+  std::copy(matrix, matrix + 12, pose.m);
+  pose = pose.inverse();
+  std::copy(pose.m, pose.m + 12, matrix);
+  return 1;
+}
+
+int transform_vector(const double * matrix, double * vector) {
+  Pose pose;
+  std::copy(matrix, matrix + 12, pose.m);
+  double r[3];
+  pose.apply(vector, r);
+  std::copy(r, r + 3, vector);
+  return 1;
+}
+
+int set_joint_target_velocity(int handle, double velocity) {
+  if (!valid(handle)) return -1;
+  scene.objects[handle].velocity = velocity;
+  return 1;
+}
+
+int get_joint_velocity(int handle, double * velocity) {
+  if (!valid(handle)) return -1;
+  *velocity = scene.objects[handle].velocity;
+  return 1;
+}
+
+int get_joint_position(int handle, double * position) {
+  if (!valid(handle)) return -1;
+  *position = scene.objects[handle].position;
+  return 1;
+}
+
+int check_proximity_sensor_ex(int sensor, int entity, int mode, double threshold,
+                              double max_angle, double * point, int * detected,
+                              double * normal) {
+  if (!valid(sensor)) return -1;
+  const double range = std::min(scene.objects[sensor].range, threshold);
+  return detect(sensor, range, point, detected, normal);
+}
+
+int get_object_color(int handle, int index, int component, float * rgb) {
+  if (handle == scene.floor) {
+    std::copy(FLOOR_COLOR, FLOOR_COLOR + 3, rgb);
+    return 1;
+  }
+  if (!valid(handle)) return -1;
+  const Object & object = scene.objects[handle];
+  const float * color = component == sim_colorcomponent_emission ? object.emission : object.color;
+  std::copy(color, color + 3, rgb);
+  return 1;
+}
+
+int set_shape_color(int handle, const char * name, int component, const float * rgb) {
+  if (!valid(handle)) return -1;
+  Object & object = scene.objects[handle];
+  float * color = component == sim_colorcomponent_emission ? object.emission : object.color;
+  std::copy(rgb, rgb + 3, color);
+  return 1;
+}
+
+int get_object_float_param(int handle, int parameter, double * value) {
+  if (!valid(handle)) return -1;
+  *value = scene.objects[handle].mass;
+  return 1;
+}
+
+int read_force_sensor(int handle, double * force, double * torque) {
+  if (!valid(handle)) return -1;
+  const auto & children = scene.objects[handle].children;
+  const double mass = children.empty() ? 0.0 : scene.objects[children[0]].mass;
+  if (force) {
+    force[0] = force[1] = 0;
+    force[2] = -9.81 * mass;
+  }
+  if (torque) std::fill(torque, torque + 3, 0.0);
+  return 1;
+}
+
+int handle_vision_sensor(int handle, double ** values, int ** counts) {
+  if (!valid(handle)) return -1;
+  if (values && counts) {
+    // one packet of 15 values: min and max intensity, red, green, blue and depth,
+    // followed by their averages
+    *values = allocate<double>(15);
+    *counts = allocate<int>(2);
+    (*counts)[0] = 1;
+    (*counts)[1] = 15;
+    std::copy(FLOOR_COLOR, FLOOR_COLOR + 3, *values + 11);
+  }
+  return 1;
+}
+
+unsigned char * get_vision_sensor_img(int handle, int options, double cutoff, const int * pos,
+                                      const int * size, int * resolution) {
+  if (!valid(handle)) return nullptr;
+  const Object & object = scene.objects[handle];
+  resolution[0] = object.resolution[0];
+  resolution[1] = object.resolution[1];
+  const size_t length = size_t(resolution[0]) * resolution[1] * 3;
+  unsigned char * buffer = allocate<unsigned char>(length);
+  memset(buffer, 128, length);
+  return buffer;
+}
+
+int get_shape_texture_id(int handle) { return valid(handle) ? scene.objects[handle].texture : -1; }
+
+int get_shape_viz(int handle, int index, SShapeVizInfo * info) {
+  if (!valid(handle)) return -1;
+  *info = SShapeVizInfo();
+  // a single triangle
+  info->indicesSize = 3;
+  info->indices = allocate<std::remove_pointer_t<decltype(info->indices)>>(3);
+  info->normals = allocate<std::remove_pointer_t<decltype(info->normals)>>(9);
+  info->textureCoords = allocate<std::remove_pointer_t<decltype(info->textureCoords)>>(9);
+  const int texture = scene.objects[handle].texture;
+  if (texture >= 0) {
+    info->textureRes[0] = scene.textures[texture].width;
+    info->textureRes[1] = scene.textures[texture].height;
+    info->texture = allocate<std::remove_pointer_t<decltype(info->texture)>>(4);
+    return 2;
+  }
+  return 1;
+}
+
+int apply_texture(int handle, const double * coordinates, int size, const unsigned char * data,
+                  const int * resolution, int options) {
+  if (!valid(handle)) return -1;
+  const int texture = add_texture(resolution[0], resolution[1]);
+  auto & buffer = scene.textures[texture].data;
+  std::copy(data, data + buffer.size(), buffer.begin());
+  scene.objects[handle].texture = texture;
+  return texture;
+}
+
+int write_texture(int id, int options, const char * data, int x, int y, int width, int height,
+                  double interpolation) {
+  if (id < 0 || id >= int(scene.textures.size())) return -1;
+  Texture & texture = scene.textures[id];
+  if (x < 0 || y < 0 || x + width > texture.width || y + height > texture.height) return -1;
+  for (int row = 0; row < height; row++) {
+    memcpy(&texture.data[(size_t(y + row) * texture.width + x) * 3], data + size_t(row) * width * 3,
+           size_t(width) * 3);
+  }
+  return 1;
+}
+
+double get_simulation_time() { return scene.time; }
+
+char * get_string_property(long long int target, const char * name) {
+  if (strcmp(name, "modelPath") == 0) return copy_string(scene.model_path);
+  return nullptr;
+}
+
+}  // namespace
+
+ptrSimReleaseBuffer simReleaseBuffer = release_buffer;
+ptrSimGetObject simGetObject = get_object;
+ptrSimGetObjectUid simGetObjectUid = get_object_uid;
+ptrSimGetObjectAlias simGetObjectAlias = get_object_alias;
+ptrSimGetObjectType simGetObjectType = get_object_type;
+ptrSimGetObjectsInTree simGetObjectsInTree = get_objects_in_tree;
+ptrSimGetObjectPosition simGetObjectPosition = get_object_position;
+ptrSimGetObjectOrientation simGetObjectOrientation = get_object_orientation;
+ptrSimGetObjectMatrix simGetObjectMatrix = get_object_matrix;
+ptrSimSetObjectQuaternion simSetObjectQuaternion = set_object_quaternion;
+ptrSimGetObjectVelocity simGetObjectVelocity = get_object_velocity;
+ptrSimInvertMatrix simInvertMatrix = invert_matrix;
+ptrSimTransformVector simTransformVector = transform_vector;
+ptrSimSetJointTargetVelocity simSetJointTargetVelocity = set_joint_target_velocity;
+ptrSimGetJointVelocity simGetJointVelocity = get_joint_velocity;
+ptrSimGetJointPosition simGetJointPosition = get_joint_position;
+ptrSimCheckProximitySensorEx simCheckProximitySensorEx = check_proximity_sensor_ex;
+ptrSimGetObjectColor simGetObjectColor = get_object_color;
+ptrSimSetShapeColor simSetShapeColor = set_shape_color;
+ptrSimGetObjectFloatParam simGetObjectFloatParam = get_object_float_param;
+ptrSimReadForceSensor simReadForceSensor = read_force_sensor;
+ptrSimHandleVisionSensor simHandleVisionSensor = handle_vision_sensor;
+ptrSimGetVisionSensorImg simGetVisionSensorImg = get_vision_sensor_img;
+ptrSimGetShapeTextureId simGetShapeTextureId = get_shape_texture_id;
+ptrSimGetShapeViz simGetShapeViz = get_shape_viz;
+ptrSimApplyTexture simApplyTexture = apply_texture;
+ptrSimWriteTexture simWriteTexture = write_texture;
+ptrSimGetSimulationTime simGetSimulationTime = get_simulation_time;
+ptrSimGetStringProperty simGetStringProperty = get_string_property;
+
+namespace MockSim {
+
+enum { THYMIO2, EPUCK };
+
+void clear() {
+  Scene empty;
+  empty.model_path = scene.model_path;
+  scene = std::move(empty);
+  scene.floor = add_object("/Floor", sim_object_shape_type, -1, Pose());
+}
+
+int add_thymio2(double x, double y, double yaw) {
+  if (scene.floor < 0) clear();
+  const std::string base = unique_name("Thymio");
+  const int handle = add_object(base, sim_object_shape_type, -1, Pose::from(x, y, 0, yaw));
+  const int body = add_object(base + "/Body", sim_object_shape_type, handle, Pose());
+  scene.objects[body].texture = model_texture(THYMIO2, 0);
+  add_body(body, 0.03, 0.045);
+  for (const auto & [side, y_] : {std::make_pair("Left", 0.047), std::make_pair("Right", -0.047)}) {
+    add_object(base + "/" + side + "Motor", sim_object_joint_type, handle,
+               Pose::from(0, y_, 0.022, 0));
+  }
+  const char * names[7] = {"Left", "CenterLeft", "Center", "CenterRight",
+                           "Right", "RearLeft", "RearRight"};
+  const double angles[7] = {0.7, 0.35, 0, -0.35, -0.7, M_PI, M_PI};
+  for (int i = 0; i < 7; i++) {
+    const double r = 0.06;
+    const double px = i < 5 ? r * cos(angles[i]) : -0.045;
+    const double py = i < 5 ? r * sin(angles[i]) : (i == 5 ? 0.03 : -0.03);
+    const std::string path = base + "/Proximity" + names[i];
+    const int sensor = add_sensor(path, handle, px, py, 0.03, angles[i], 0.12);
+    int comm = add_object(path + "/Comm", sim_object_proximitysensor_type, sensor, Pose());
+    scene.objects[comm].range = 0.5;
+  }
+  for (const auto & [side, y_] : {std::make_pair("Left", 0.011), std::make_pair("Right", -0.011)}) {
+    const std::string path = base + "/Ground" + side;
+    const int sensor = add_ground_sensor(path, handle, 0.07, y_);
+    const int vision = add_object(path + "/Vision", sim_object_visionsensor_type, sensor, Pose());
+    scene.objects[vision].resolution[0] = scene.objects[vision].resolution[1] = 1;
+  }
+  add_accelerometer(base, handle, 0.27);
+  for (const char * name : {"Backward", "Left", "Center", "Forward", "Right"}) {
+    add_object(base + "/Button" + name, sim_object_shape_type, handle, Pose());
+  }
+  return handle;
+}
+
+int add_epuck(double x, double y, double yaw) {
+  if (scene.floor < 0) clear();
+  const std::string base = unique_name("ePuck");
+  const int handle = add_object(base, sim_object_shape_type, -1, Pose::from(x, y, 0, yaw));
+  for (const auto & [side, y_] : {std::make_pair("Left", 0.026), std::make_pair("Right", -0.026)}) {
+    add_object(base + "/" + side + "Motor", sim_object_joint_type, handle,
+               Pose::from(0, y_, 0.02, 0));
+  }
+  const double angles[8] = {-0.3, -0.8, -M_PI / 2, -2.64, 2.64, M_PI / 2, 0.8, 0.3};
+  for (int i = 0; i < 8; i++) {
+    add_sensor(base + "/Proximity_" + std::to_string(i), handle, 0.037 * cos(angles[i]),
+               0.037 * sin(angles[i]), 0.03, angles[i], 0.07);
+  }
+  add_accelerometer(base, handle, 0.15);
+  const int camera = add_object(base + "/Camera", sim_object_visionsensor_type, handle,
+                                Pose::from(0.035, 0, 0.03, 0));
+  scene.objects[camera].resolution[0] = scene.objects[camera].resolution[1] = 60;
+  add_object(base + "/Gyroscope", sim_object_dummy_type, handle, Pose());
+  const int ring = add_object(base + "/Ring", sim_object_shape_type, handle, Pose());
+  scene.objects[ring].texture = model_texture(EPUCK, 0);
+  const int body = add_object(base + "/Body", sim_object_shape_type, handle, Pose());
+  add_body(body, 0.025, 0.032);
+  add_object(base + "/Rest", sim_object_shape_type, handle, Pose());
+  add_object(base + "/FrontLed", sim_object_shape_type, handle, Pose());
+  return handle;
+}
+
+void step(double dt) {
+  scene.time += dt;
+  for (auto & object : scene.objects) {
+    if (object.type == sim_object_joint_type) object.position += object.velocity * dt;
+  }
+}
+
+double time() { return scene.time; }
+
+size_t number_of_objects() { return scene.objects.size(); }
+
+void set_model_path(const std::string & path) { scene.model_path = path; }
+
+}  // namespace MockSim
@@ -0,0 +1,153 @@
+#include "outbound_queue.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
+
+#include "common/consts.h"
+
+// [bytes] written at once when the socket is writable, which should fit in its buffer
+static const size_t WRITE_BUDGET = 2048;
+
+// Messages are (payload size, source, type, payload...), in little-endian words
+static uint16_t word(const std::vector<uint8_t> & frame, size_t index) {
+  return frame[2 * index] | (frame[2 * index + 1] << 8);
+}
+
+static uint64_t key_of(const std::vector<uint8_t> & frame) {
+  if (frame.size() < 6) return 0;
+  const uint16_t source = word(frame, 1);
+  const uint16_t type = word(frame, 2);
+  uint16_t start = 0;
+  if (type == ASEBA_MESSAGE_VARIABLES) {
+    if (frame.size() < 8) return 0;
+    // replies for different ranges are different values
+    start = word(frame, 3);
+  } else if (type >= 0x8000) {
+    // system messages
+    return 0;
+  }
+  return (uint64_t(1) << 48) | (uint64_t(source) << 32) | (uint64_t(type) << 16) | start;
+}
+
+// Whether the socket can take more data without blocking. Dashel does not tell,
+// but tells which socket it uses.
+static bool writable(Dashel::Stream * stream) {
+  const std::string sock = stream->getTargetParameter("sock");
+  if (sock.empty()) return true;
+#ifdef _WIN32
+  WSAPOLLFD fd = {(SOCKET)std::atoll(sock.c_str()), POLLWRNORM, 0};
+  return WSAPoll(&fd, 1, 0) > 0 && (fd.revents & POLLWRNORM);
+#else
+  pollfd fd = {std::atoi(sock.c_str()), POLLOUT, 0};
+  return poll(&fd, 1, 0) > 0 && (fd.revents & POLLOUT);
+#endif
+}
+
+bool OutboundQueue::droppable(const std::vector<uint8_t> & frame) {
+  return key_of(frame) != 0;
+}
+
+bool OutboundQueue::write_all(Dashel::Stream * stream,
+                              const std::vector<std::vector<uint8_t>> & frames) {
+  if (frames.empty()) return true;
+  try {
+    for (const auto & frame : frames) {
+      stream->write(frame.data(), frame.size());
+    }
+    stream->flush();
+  } catch (Dashel::DashelException & e) {
+    log_warn("Cannot write to socket: %s", stream->getFailReason().c_str());
+    return false;
+  }
+  return true;
+}
+
+void OutboundQueue::push(std::vector<uint8_t> && frame) {
+  const uint64_t key = policy == BLOCK ? 0 : key_of(frame);
+  if (policy == LATEST && key) {
+    const auto it = latest.find(key);
+    if (it != latest.end()) {
+      it->second->frame = std::move(frame);
+      coalesced.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  if (key && messages.size() >= capacity) {
+    drop_oldest();
+  }
+  messages.push_back({std::move(frame), key});
+  if (policy == LATEST && key) {
+    latest[key] = std::prev(messages.end());
+  }
+  update_depth();
+}
+
+void OutboundQueue::drop_oldest() {
+  for (auto it = messages.begin(); it != messages.end(); ++it) {
+    if (!it->key) continue;
+    latest.erase(it->key);
+    messages.erase(it);
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+}
+
+bool OutboundQueue::write(Dashel::Stream * stream) {
+  if (policy == BLOCK) {
+    std::vector<std::vector<uint8_t>> frames;
+    take(frames);
+    return write_all(stream, frames);
+  }
+  try {
+    while (!messages.empty()) {
+      if (!writable(stream)) break;
+      size_t budget = WRITE_BUDGET;
+      // at least one message, even if larger than the budget
+      while (!messages.empty() &&
+             (budget == WRITE_BUDGET || budget >= messages.front().frame.size())) {
+        const Message & message = messages.front();
+        stream->write(message.frame.data(), message.frame.size());
+        budget -= std::min(budget, message.frame.size());
+        if (message.key) latest.erase(message.key);
+        messages.pop_front();
+      }
+      update_depth();
+      stream->flush();
+    }
+  } catch (Dashel::DashelException & e) {
+    log_warn("Cannot write to socket: %s", stream->getFailReason().c_str());
+    clear();
+    return false;
+  }
+  return true;
+}
+
+void OutboundQueue::take(std::vector<std::vector<uint8_t>> & frames) {
+  frames.reserve(frames.size() + messages.size());
+  for (auto & message : messages) {
+    frames.push_back(std::move(message.frame));
+  }
+  clear();
+}
+
+void OutboundQueue::clear() {
+  messages.clear();
+  latest.clear();
+  update_depth();
+}
+
+void OutboundQueue::update_depth() {
+  const size_t size = messages.size();
+  depth.store(size, std::memory_order_relaxed);
+  if (size > max_depth.load(std::memory_order_relaxed)) {
+    max_depth.store(size, std::memory_order_relaxed);
+  }
+}
@@ -30,11 +30,21 @@
 #include "plugin.h"
 // #include <chrono>
 #include <map>
+#include <numeric>
 #include <set>
 #include "config.h"
 #include "simPlusPlus/Plugin.h"
 #include "stubs.h"
+#include "aseba_async_script.h"
 #include "aseba_network.h"
+#include "aseba_script_cache.h"
+#include "command_buffer_dispatch.h"
+#include "camera_export.h"
+#include "command_ring.h"
+#include "state_mirror.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "variable_watches.h"
 #include "coppeliasim_aseba_node.h"
 #include "aseba_thymio2.h"
 #include "aseba_epuck.h"
@@ -55,6 +65,80 @@ unsigned free_uid(int i = -1) {
   return i;
 }
 
+// The lowest n free uids, in a single pass over the used ones
+std::vector<unsigned> free_uids(size_t n) {
+  std::vector<unsigned> ids;
+  ids.reserve(n);
+  unsigned i = 0;
+  auto it = uids.begin();
+  while (ids.size() < n) {
+    if (it != uids.end() && *it == i) {
+      it++;
+    } else {
+      ids.push_back(i);
+    }
+    i++;
+  }
+  return ids;
+}
+
+// The robots with the given ids (all robots, in id order, if empty; null if missing).
+// Resolved once and reused as long as the same ids are requested and no robot
+// has been added or removed.
+template <typename T>
+struct RobotSelection {
+  std::vector<int> ids;
+  std::vector<T *> robots;
+  unsigned version = 0;
+  bool valid = false;
+
+  const std::vector<T *> & select(std::map<int, T> & all, const std::vector<int> & ids_,
+                                  unsigned version_) {
+    if (valid && version == version_ && ids == ids_) return robots;
+    ids = ids_;
+    version = version_;
+    valid = true;
+    robots.clear();
+    if (ids.empty()) {
+      for (auto & [uid, robot] : all) robots.push_back(&robot);
+    } else {
+      for (int uid : ids) {
+        auto it = all.find(uid);
+        robots.push_back(it == all.end() ? nullptr : &(it->second));
+      }
+    }
+    return robots;
+  }
+};
+
+template <typename T>
+void write_observations(const std::vector<T *> & robots, unsigned fields,
+                        std::vector<float> & buffer, std::string & output, int & size) {
+  size = 0;
+  for (const T * robot : robots) {
+    if (robot) {
+      size = robot->observations_size(fields);
+      break;
+    }
+  }
+  // NOTE(Jerome): missing robots are left to zero
+  buffer.assign(size * robots.size(), 0.0f);
+  float * values = buffer.data();
+  for (const T * robot : robots) {
+    if (robot) robot->write_observations(fields, values);
+    values += size;
+  }
+  output.assign(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(float));
+}
+
+// The number of robots with a complete set of actions
+static size_t number_of_actions(size_t robots, size_t values, size_t size, const char * name) {
+  if (values != robots * size) {
+    log_warn("Expected %zu %s (%zu per robot), got %zu", robots * size, name, size, values);
+  }
+  return std::min(robots, values / size);
+}
+
 uint64_t micros() {
     uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
             std::chrono::high_resolution_clock::now().time_since_epoch())
@@ -77,6 +161,18 @@ class Plugin : public sim::Plugin {
         setBuildDate(BUILD_DATE);
         sim::registerScriptVariable("simThymio", "require('simThymio-typecheck')", 0);
         sim::registerScriptVariable("simEPuck", "require('simEPuck-typecheck')", 0);
+        Logging::refresh_verbosity();
+    }
+
+#if SIM_PROGRAM_VERSION_NB < 40600
+    void onEnd() {
+#else
+    void onCleanup() {
+#endif
+      Aseba::stop_script_compiler();
+      Aseba::configure_io_thread(false, 0);
+      CoppeliaSimAsebaNode::deferred_calls = nullptr;
+      Logging::configure("", false);
     }
 
     void onScriptStateDestroyed(int scriptID) {
@@ -85,6 +181,7 @@ class Plugin : public sim::Plugin {
     }
 
     void onSimulationAboutToStart() {
+      simulation_step = 0;
       simSetInt32Param(
           sim_intparam_prox_sensor_select_down, sim_objectspecialproperty_detectable);
       simSetInt32Param(
@@ -92,6 +189,7 @@ class Plugin : public sim::Plugin {
     }
 
     void onSimulationAboutToEnd() {
+      Aseba::cancel_scripts();
       while (thymios.size()) {
         auto it = thymios.begin();
         destroy_node_with_uid(it->first);
@@ -109,24 +207,58 @@ class Plugin : public sim::Plugin {
 #else 
     void onSimulationBeforeActuation() {
 #endif
-      simFloat time_step = simGetSimulationTimeStep();
-      for (auto uid : standalone_thymios) {
-        thymios.at(uid).do_step(time_step);
+      Logging::refresh_verbosity();
+      step();
+      Profiler::end_step();
+      Logging::flush();
+    }
+
+    void step() {
+      PROFILE_SCOPE(STEP);
+      TRACE_SCOPE("step", int(simulation_step + 1));
+      for (const auto & result : Aseba::install_compiled_scripts()) {
+        notify_script_result(result);
       }
-      for (auto uid : standalone_epucks) {
-        epucks.at(uid).do_step(time_step);
+      simulation_step++;
+      command_ring.drain(simulation_step, [this](const aseba_shm_command_t & command) {
+        execute_command(command);
+      });
+      simFloat time_step = simGetSimulationTimeStep();
+      {
+        PROFILE_SCOPE(STANDALONE_ROBOTS);
+        for (auto uid : standalone_thymios) {
+          thymios.at(uid).do_step(time_step);
+        }
+        for (auto uid : standalone_epucks) {
+          epucks.at(uid).do_step(time_step);
+        }
       }
-      for (auto & [uid, thymio] : thymios) {
-        if (thymio.prox_comm_enabled()) {
-            thymio.reset_prox_comm_rx();
-          for (const auto & [tid, tx] : prox_comm_tx) {
-            if (uid == tid) continue;
-            // printf("push tx %d %d\n", tid, tx);
-            thymio.update_prox_comm(thymios.at(tid).prox_comm_emitter_handles(), tx);
+      {
+        PROFILE_SCOPE(PROX_COMM);
+        for (auto & [uid, thymio] : thymios) {
+          if (thymio.prox_comm_enabled()) {
+              thymio.reset_prox_comm_rx();
+            for (const auto & [tid, tx] : prox_comm_tx) {
+              if (uid == tid) continue;
+              // printf("push tx %d %d\n", tid, tx);
+              thymio.update_prox_comm(thymios.at(tid).prox_comm_emitter_handles(), tx);
+            }
           }
         }
       }
-      Aseba::spin(time_step);
+      {
+        PROFILE_SCOPE(SPIN);
+        TRACE_SCOPE("spin");
+        Aseba::spin(time_step);
+      }
+      {
+        TRACE_SCOPE("deferred_calls");
+        deferred_calls.flush();
+      }
+      if (!watches.empty()) {
+        watches.check();
+        notify_watches();
+      }
       prox_comm_tx.clear();
       for (const auto & [uid, thymio] : thymios) {
         if (thymio.prox_comm_enabled()) {
@@ -134,6 +266,17 @@ class Plugin : public sim::Plugin {
           // printf("set tx %d %d\n", uid, prox_comm_tx[uid]);
         }
       }
+      state_mirror.publish(thymios, epucks, simulation_step, simGetSimulationTime());
+    }
+
+#if SIM_PROGRAM_VERSION_NB < 40600
+    void onInstancePass(const sim::InstancePassFlags &flags, bool first) {
+#else
+    void onInstancePass(const sim::InstancePassFlags &flags) {
+#endif
+      // also while the simulation is stopped or paused
+      Aseba::spin_stats();
+      Logging::flush();
     }
 
     void onGuiPass() {
@@ -163,20 +306,21 @@ class Plugin : public sim::Plugin {
       }
     }
 
-    void _thymio2_create(_thymio2_create_in *in, _thymio2_create_out *out) {
-      int uid = free_uid(in->id);
+    void add_thymio(unsigned uid, int handle, bool with_aseba, int behavior_mask,
+                    const std::string & friendly_name, int port) {
       uids.insert(uid);
+      robots_version++;
       thymios.emplace(std::piecewise_construct, std::forward_as_tuple(uid),
-                      std::forward_as_tuple(in->handle, in->behavior_mask));
+                      std::forward_as_tuple(handle, behavior_mask));
       std::array<uint8_t, 16> uuid;
       char s[17];
       snprintf(s, sizeof(s), "coppeliasim %04d", uid);
       std::copy(s, s+16, uuid.data());
       CS::Thymio2 & thymio = thymios.at(uid);
-      if (in->with_aseba) {
+      if (with_aseba) {
         AsebaThymio2 * node = Aseba::create_node<AsebaThymio2>(
-            uid, in->port, "thymio-II", uuid, in->friendly_name);
-        node->set_script_id(simGetScriptHandleEx(sim_scripttype_childscript, in->handle, nullptr));
+            uid, port, "thymio-II", uuid, friendly_name);
+        node->set_script_id(simGetScriptHandleEx(sim_scripttype_childscript, handle, nullptr));
         node->robot = &thymio;
       } else {
         standalone_thymios.insert(uid);
@@ -186,30 +330,62 @@ class Plugin : public sim::Plugin {
         buttons[button_handle] = std::make_pair(uid, i);
         i++;
       }
-      out->id = uid;
     }
 
-    void _epuck_create(_epuck_create_in *in, _epuck_create_out *out) {
-      int uid = free_uid(in->id);
+    void add_epuck(unsigned uid, int handle, bool with_aseba, int port) {
       uids.insert(uid);
+      robots_version++;
       epucks.emplace(std::piecewise_construct, std::forward_as_tuple(uid),
-                     std::forward_as_tuple(in->handle));
-      std::array<uint8_t, 16> uuid;
-      char s[17];
-      snprintf(s, sizeof(s), "coppeliasim %04d", uid);
-      std::copy(s, s+16, uuid.data());
+                     std::forward_as_tuple(handle));
       CS::EPuck & robot = epucks.at(uid);
-      if (in->with_aseba) {
+      if (camera_export.is_open()) {
+        export_camera(uid, robot);
+      }
+      if (with_aseba) {
         AsebaEPuck * node = Aseba::create_node<AsebaEPuck>(
-            uid, in->port, "e-puck0");
-        node->set_script_id(simGetScriptHandleEx(sim_scripttype_childscript, in->handle, nullptr));
+            uid, port, "e-puck0");
+        node->set_script_id(simGetScriptHandleEx(sim_scripttype_childscript, handle, nullptr));
         node->robot = &robot;
       } else {
         standalone_epucks.insert(uid);
       }
+    }
+
+    void _thymio2_create(_thymio2_create_in *in, _thymio2_create_out *out) {
+      int uid = free_uid(in->id);
+      add_thymio(uid, in->handle, in->with_aseba, in->behavior_mask, in->friendly_name, in->port);
       out->id = uid;
     }
 
+    // NOTE(Jerome): the layout of the model is resolved for the first instance
+    // and then reused (see CS::ModelLayout)
+    void _thymio2_create_many(_thymio2_create_many_in *in, _thymio2_create_many_out *out) {
+      std::vector<unsigned> ids = free_uids(in->handles.size());
+      out->ids.reserve(ids.size());
+      for (size_t i = 0; i < ids.size(); i++) {
+        add_thymio(ids[i], in->handles[i], in->with_aseba, in->behavior_mask,
+                   in->friendly_name, in->port);
+        out->ids.push_back(ids[i]);
+      }
+      log_info("Created %lu Thymio2", ids.size());
+    }
+
+    void _epuck_create(_epuck_create_in *in, _epuck_create_out *out) {
+      int uid = free_uid(in->id);
+      add_epuck(uid, in->handle, in->with_aseba, in->port);
+      out->id = uid;
+    }
+
+    void _epuck_create_many(_epuck_create_many_in *in, _epuck_create_many_out *out) {
+      std::vector<unsigned> ids = free_uids(in->handles.size());
+      out->ids.reserve(ids.size());
+      for (size_t i = 0; i < ids.size(); i++) {
+        add_epuck(ids[i], in->handles[i], in->with_aseba, in->port);
+        out->ids.push_back(ids[i]);
+      }
+      log_info("Created %lu e-pucks", ids.size());
+    }
+
     void create_node(create_node_in *in, create_node_out *out) {
       int uid = free_uid(in->id);
       uids.insert(uid);
@@ -234,6 +410,7 @@ class Plugin : public sim::Plugin {
     }
 
     void destroy_node_with_uid(unsigned uid) {
+      robots_version++;
       if (thymios.count(uid)) {
         CS::Thymio2 & thymio = thymios.at(uid);
         for (int button_handle : thymio.button_handles()) {
@@ -242,8 +419,10 @@ class Plugin : public sim::Plugin {
         thymios.erase(uid);
       }
       if (epucks.count(uid)) {
+        camera_export.detach(epucks.at(uid).get_camera_channel());
         epucks.erase(uid);
       }
+      watches.remove_node(uid);
       Aseba::destroy_node(uid);
       uids.erase(uid);
       if (standalone_thymios.count(uid)) {
@@ -318,6 +497,31 @@ class Plugin : public sim::Plugin {
       }
     }
 
+    void _thymio2_get_observations(_thymio2_get_observations_in *in,
+                                   _thymio2_get_observations_out *out) {
+      write_observations(selected_thymios.select(thymios, in->ids, robots_version),
+                         in->fields, observations, out->observations, out->size);
+    }
+
+    // NOTE(Jerome): the setters do nothing (and do not call the simulator)
+    // when a value has not changed
+    void _thymio2_set_actions(_thymio2_set_actions_in *in, _thymio2_set_actions_out *out) {
+      const auto & robots = selected_thymios.select(thymios, in->ids, robots_version);
+      size_t number = number_of_actions(robots.size(), in->targets.size(), 2, "targets");
+      for (size_t i = 0; i < number; i++) {
+        if (!robots[i]) continue;
+        robots[i]->set_target_speed(0, in->targets[2 * i]);
+        robots[i]->set_target_speed(1, in->targets[2 * i + 1]);
+      }
+      if (in->leds.empty()) return;
+      number = number_of_actions(robots.size(), in->leds.size(), 3, "led values");
+      for (size_t i = 0; i < number; i++) {
+        if (!robots[i]) continue;
+        robots[i]->set_led_color(CS::LED::TOP, false, in->leds[3 * i], in->leds[3 * i + 1],
+                                 in->leds[3 * i + 2]);
+      }
+    }
+
     void _epuck_set_target_speed(_epuck_set_target_speed_in *in,
                                  _epuck_set_target_speed_out *out) {
       if (in->id == -1) {
@@ -357,6 +561,33 @@ class Plugin : public sim::Plugin {
       }
     }
 
+    void _epuck_get_observations(_epuck_get_observations_in *in,
+                                 _epuck_get_observations_out *out) {
+      write_observations(selected_epucks.select(epucks, in->ids, robots_version),
+                         in->fields, observations, out->observations, out->size);
+    }
+
+    void _epuck_set_actions(_epuck_set_actions_in *in, _epuck_set_actions_out *out) {
+      const auto & robots = selected_epucks.select(epucks, in->ids, robots_version);
+      size_t number = number_of_actions(robots.size(), in->targets.size(), 2, "targets");
+      for (size_t i = 0; i < number; i++) {
+        if (!robots[i]) continue;
+        robots[i]->set_target_speed(0, in->targets[2 * i]);
+        robots[i]->set_target_speed(1, in->targets[2 * i + 1]);
+      }
+      if (in->leds.empty()) return;
+      number = number_of_actions(robots.size(), in->leds.size(), 1, "led masks");
+      for (size_t i = 0; i < number; i++) {
+        if (!robots[i]) continue;
+        const int mask = in->leds[i];
+        for (size_t j = 0; j < 8; j++) {
+          robots[i]->set_ring_led(j, mask & (1 << j));
+        }
+        robots[i]->set_body_led(mask & (1 << 8));
+        robots[i]->set_front_led(mask & (1 << 9));
+      }
+    }
+
     // void connect_node(connect_node_in *in, connect_node_out *out) {
     //   DynamicAsebaNode * node = Aseba::node_with_handle(in->id);
     //   if (node)
@@ -387,6 +618,214 @@ class Plugin : public sim::Plugin {
         node->emit(in->name);
     }
 
+    void resolve_variable(resolve_variable_in *in, resolve_variable_out *out) {
+      out->handle = variable_handles().resolve(in->name);
+    }
+
+    void resolve_event(resolve_event_in *in, resolve_event_out *out) {
+      out->handle = event_handles().resolve(in->name);
+    }
+
+    void get_variable_with_handle(get_variable_with_handle_in *in,
+                                  get_variable_with_handle_out *out) {
+      DynamicAsebaNode *node = Aseba::node_with_handle(in->id);
+      if (node && in->handle >= 0) {
+        auto [address, size] = node->variable_with_handle(in->handle);
+        out->value.assign(address, address + size);
+      }
+    }
+
+    void set_variable_with_handle(set_variable_with_handle_in *in,
+                                  set_variable_with_handle_out *out) {
+      DynamicAsebaNode *node = Aseba::node_with_handle(in->id);
+      if (node && in->handle >= 0) {
+        auto [address, size] = node->variable_with_handle(in->handle);
+        std::copy_n(in->value.begin(), std::min<size_t>(size, in->value.size()), address);
+      }
+    }
+
+    void get_scalars(get_scalars_in *in, get_scalars_out *out) {
+      out->values.assign(in->ids.size() * in->handles.size(), 0);
+      if (in->index < 0) return;
+      auto value = out->values.begin();
+      for (int id : in->ids) {
+        DynamicAsebaNode *node = Aseba::node_with_handle(id);
+        for (int handle : in->handles) {
+          if (node && handle >= 0) {
+            auto [address, size] = node->variable_with_handle(handle);
+            if (unsigned(in->index) < size) *value = address[in->index];
+          }
+          ++value;
+        }
+      }
+    }
+
+    void set_scalars(set_scalars_in *in, set_scalars_out *out) {
+      if (in->handle < 0 || in->index < 0) return;
+      const size_t number = std::min(in->ids.size(), in->values.size());
+      if (number < in->ids.size()) {
+        log_warn("set_scalars: expected %lu values, got %lu", in->ids.size(), in->values.size());
+      }
+      for (size_t i = 0; i < number; i++) {
+        DynamicAsebaNode *node = Aseba::node_with_handle(in->ids[i]);
+        if (!node) continue;
+        auto [address, size] = node->variable_with_handle(in->handle);
+        if (unsigned(in->index) < size) address[in->index] = in->values[i];
+      }
+    }
+
+    void emit_event_with_handle(emit_event_with_handle_in *in,
+                                emit_event_with_handle_out *out) {
+      if (in->handle < 0) return;
+      for (int id : in->ids) {
+        DynamicAsebaNode *node = Aseba::node_with_handle(id);
+        if (!node) continue;
+        int event = node->event_with_handle(in->handle);
+        if (event >= 0) node->emit((uint16_t) event);
+      }
+    }
+
+    void configure_profiler(configure_profiler_in *in, configure_profiler_out *out) {
+#ifdef ASEBA_PROFILING
+      if (in->reset) {
+        Profiler::reset();
+      }
+      Profiler::configure(in->enabled, std::max(in->log_period, 0));
+      out->success = true;
+#else
+      log_warn("The plugin has been compiled without ASEBA_PROFILING");
+      out->success = false;
+#endif
+    }
+
+    void configure_logging(configure_logging_in *in, configure_logging_out *out) {
+      out->success = Logging::configure(in->path, in->asynchronous);
+    }
+
+    void get_stats(get_stats_in *in, get_stats_out *out) {
+      for (const auto & [uid, node] : Aseba::all_nodes()) {
+        const AsebaNodeStats & s = node->stats;
+        out->nodes.push_back(uid);
+        out->vm_runs.push_back(s.vm_runs);
+        out->vm_instructions.push_back(s.vm_instructions);
+        out->events_emitted.push_back(s.events_emitted);
+        out->events_interrupted.push_back(s.events_interrupted);
+        out->events_dropped.push_back(s.events_dropped);
+        out->native_calls.push_back(
+            std::accumulate(s.native_calls.begin(), s.native_calls.end(), uint64_t(0)));
+        out->lua_calls.push_back(s.lua_calls);
+        out->lua_time.push_back(s.lua_time);
+      }
+      for (const auto & [port, s] : Aseba::network_stats()) {
+        out->ports.push_back(port);
+        out->messages_received.push_back(s.messages_in);
+        out->bytes_received.push_back(s.bytes_in);
+        out->messages_sent.push_back(s.messages_out);
+        out->bytes_sent.push_back(s.bytes_out);
+        out->messages_dropped.push_back(s.messages_dropped);
+        out->messages_coalesced.push_back(s.messages_coalesced);
+        out->queue_depth.push_back(s.queue_depth);
+        out->max_queue_depth.push_back(s.max_queue_depth);
+        out->clients.push_back(s.clients);
+        out->clients_dropped.push_back(s.clients_dropped);
+        out->requests_dropped.push_back(s.requests_dropped);
+      }
+    }
+
+    void get_native_calls(get_native_calls_in *in, get_native_calls_out *out) {
+      DynamicAsebaNode *node = Aseba::node_with_handle(in->id);
+      if (node) {
+        out->calls.assign(node->stats.native_calls.begin(), node->stats.native_calls.end());
+      }
+    }
+
+    void serve_stats(serve_stats_in *in, serve_stats_out *out) {
+      out->success = Aseba::serve_stats(in->port);
+    }
+
+    void start_trace(start_trace_in *in, start_trace_out *out) {
+#ifdef ASEBA_TRACING
+      Tracer::start(std::max(in->capacity, 1));
+      out->success = true;
+#else
+      log_warn("The plugin has been compiled without ASEBA_TRACING");
+      out->success = false;
+#endif
+    }
+
+    void stop_trace(stop_trace_in *in, stop_trace_out *out) {
+      Tracer::stop();
+    }
+
+    void dump_trace(dump_trace_in *in, dump_trace_out *out) {
+      out->events = Tracer::dump(in->path);
+      out->success = out->events >= 0;
+    }
+
+    void get_profile(get_profile_in *in, get_profile_out *out) {
+      for (const auto & s : Profiler::summary()) {
+        out->phases.push_back(s.phase);
+        out->count.push_back(s.count);
+        out->min.push_back(s.min);
+        out->mean.push_back(s.mean);
+        out->p99.push_back(s.p99);
+        out->max.push_back(s.max);
+      }
+    }
+
+    void configure_functions(configure_functions_in *in, configure_functions_out *out) {
+      if (!in->deferred) {
+        deferred_calls.flush();
+      }
+      CoppeliaSimAsebaNode::deferred_calls = in->deferred ? &deferred_calls : nullptr;
+    }
+
+    void watch_variable(watch_variable_in *in, watch_variable_out *out) {
+      out->watch = watches.add(in->id, variable_handles().resolve(in->name),
+                               std::max(in->start, 0), in->size);
+      if (out->watch < 0) {
+        log_warn("Cannot watch variable %s of node %d", in->name.c_str(), in->id);
+      }
+    }
+
+    void unwatch_variable(unwatch_variable_in *in, unwatch_variable_out *out) {
+      if (in->watch == -1) {
+        watches.clear();
+      } else {
+        watches.remove(in->watch);
+      }
+    }
+
+    void configure_watches(configure_watches_in *in, configure_watches_out *out) {
+      watch_callback = in->callback;
+      watch_script_id = in->_.scriptID;
+      watches.set_capacity(std::max(in->capacity, 1));
+    }
+
+    void get_watched_changes(get_watched_changes_in *in, get_watched_changes_out *out) {
+      out->watches = watches.changed_watches();
+      out->sizes = watches.changed_sizes();
+      out->values = watches.changed_values();
+      watches.clear_changes();
+    }
+
+    // NOTE(Jerome): all changes of a step are delivered with a single call
+    void notify_watches() {
+      if (watch_callback.empty() || !watches.has_changes()) return;
+      int stack_id = simCreateStack();
+      const auto & changed = watches.changed_watches();
+      const auto & sizes = watches.changed_sizes();
+      const auto & values = watches.changed_values();
+      simPushInt32TableOntoStack(stack_id, changed.data(), changed.size());
+      simPushInt32TableOntoStack(stack_id, sizes.data(), sizes.size());
+      simPushInt32TableOntoStack(stack_id, values.data(), values.size());
+      if (simCallScriptFunctionEx(watch_script_id, watch_callback.c_str(), stack_id) == -1) {
+        log_warn("Failed to call %s", watch_callback.c_str());
+      }
+      simReleaseStack(stack_id);
+      watches.clear_changes();
+    }
+
     void add_event(add_event_in *in, add_event_out *out) {
       DynamicAsebaNode *node = Aseba::node_with_handle(in->id);
       if (node)
@@ -444,6 +883,161 @@ class Plugin : public sim::Plugin {
       }
     }
 
+    void load_script_async(load_script_async_in *in, load_script_async_out *out) {
+      DynamicAsebaNode *node = Aseba::node_with_handle(in->id);
+      out->ticket = -1;
+      if (node) {
+        out->ticket = Aseba::compile_script_async(node, in->id, in->path, true,
+                                                  in->_.scriptID, in->callback);
+      }
+    }
+
+    void set_script_async(set_script_async_in *in, set_script_async_out *out) {
+      DynamicAsebaNode *node = Aseba::node_with_handle(in->id);
+      out->ticket = -1;
+      if (node) {
+        out->ticket = Aseba::compile_script_async(node, in->id, in->code, false,
+                                                  in->_.scriptID, in->callback);
+      }
+    }
+
+    void get_script_status(get_script_status_in *in, get_script_status_out *out) {
+      out->status = Aseba::script_status(in->ticket, out->message);
+    }
+
+    void notify_script_result(const Aseba::ScriptResult & result) {
+      if (result.callback.empty()) return;
+      int stack_id = simCreateStack();
+      simPushInt32OntoStack(stack_id, result.ticket);
+      simPushBoolOntoStack(stack_id, result.success);
+      simPushStringOntoStack(stack_id, result.message.c_str(), 0);
+      if (simCallScriptFunctionEx(result.script_id, result.callback.c_str(), stack_id) == -1) {
+        log_warn("Failed to call %s for script %d", result.callback.c_str(), result.ticket);
+      }
+      simReleaseStack(stack_id);
+    }
+
+    void configure_script_cache(configure_script_cache_in *in,
+                                configure_script_cache_out *out) {
+      AsebaScriptCache::configure(in->enabled, in->path);
+    }
+
+    void execute_commands(execute_commands_in *in, execute_commands_out *out) {
+      CommandReader reader(in->commands);
+      CommandWriter writer(out->results);
+      while (!reader.at_end()) {
+        try {
+          const unsigned opcode = reader.read<uint16_t>();
+          const unsigned number_of_arguments = reader.read<uint8_t>();
+          if (!dispatch_command(*this, in->_, opcode, number_of_arguments, reader, writer)) {
+            writer.write_error("Unknown command " + std::to_string(opcode));
+            return;
+          }
+        } catch (const std::exception & e) {
+          // NOTE(Jerome): the rest of the buffer cannot be decoded reliably
+          writer.write_error(e.what());
+          return;
+        }
+      }
+    }
+
+    void configure_shared_memory(configure_shared_memory_in *in,
+                                 configure_shared_memory_out *out) {
+      if (in->name.empty()) {
+        state_mirror.close();
+        out->success = true;
+      } else {
+        out->success = state_mirror.open(in->name, std::max(in->max_robots, 0), in->variables,
+                                         in->sizes);
+      }
+    }
+
+    void export_camera(unsigned uid, CS::EPuck & epuck) {
+      int channel = camera_export.attach(uid);
+      if (channel >= 0) {
+        epuck.set_camera_output(&camera_export, channel);
+      }
+    }
+
+    // NOTE(Jerome): all cameras share one region, so that a vision pipeline
+    // can map the frames of every e-puck at once
+    void _epuck_configure_camera_export(_epuck_configure_camera_export_in *in,
+                                        _epuck_configure_camera_export_out *out) {
+      for (auto & [_, epuck] : epucks) {
+        epuck.set_camera_output(nullptr, -1);
+      }
+      camera_export.close();
+      if (in->name.empty()) {
+        out->success = true;
+        return;
+      }
+      out->success = camera_export.open(in->name, std::max(in->max_cameras, 0),
+                                        std::max(in->depth, 1), CS::Camera::width,
+                                        CS::Camera::height);
+      if (out->success) {
+        for (auto & [uid, epuck] : epucks) {
+          export_camera(uid, epuck);
+        }
+      }
+    }
+
+    void configure_command_ring(configure_command_ring_in *in,
+                                configure_command_ring_out *out) {
+      if (in->name.empty()) {
+        command_ring.close();
+        out->success = true;
+      } else {
+        out->success = command_ring.open(in->name, std::max(in->capacity, 1));
+      }
+    }
+
+    void execute_command(const aseba_shm_command_t & command) {
+      switch (command.type) {
+        case ASEBA_SHM_SET_TARGET_SPEED:
+          if (thymios.count(command.id)) {
+            thymios.at(command.id).set_target_speed(0, command.values[0]);
+            thymios.at(command.id).set_target_speed(1, command.values[1]);
+          } else if (epucks.count(command.id)) {
+            epucks.at(command.id).set_target_speed(0, command.values[0]);
+            epucks.at(command.id).set_target_speed(1, command.values[1]);
+          }
+          break;
+        case ASEBA_SHM_SET_LED:
+          if (thymios.count(command.id)) {
+            thymios.at(command.id).set_led_color(command.index, false, command.values[0],
+                                                 command.values[1], command.values[2]);
+          } else if (epucks.count(command.id)) {
+            auto & epuck = epucks.at(command.id);
+            const bool value = command.values[0] > 0;
+            if (command.index < 8) {
+              epuck.set_ring_led(command.index, value);
+            } else if (command.index == 8) {
+              epuck.set_body_led(value);
+            } else if (command.index == 9) {
+              epuck.set_front_led(value);
+            }
+          }
+          break;
+        case ASEBA_SHM_SET_BUTTON:
+          if (thymios.count(command.id)) {
+            thymios.at(command.id).set_button(command.index, command.values[0] > 0);
+          }
+          break;
+        case ASEBA_SHM_SET_VARIABLE: {
+          DynamicAsebaNode *node = Aseba::node_with_handle(command.id);
+          if (node) {
+            const size_t size = std::min<size_t>(command.index, ASEBA_SHM_COMMAND_WORDS);
+            node->set_variable(
+                std::string(command.variable, strnlen(command.variable, ASEBA_SHM_NAME_SIZE)),
+                std::vector<int>(command.words, command.words + size));
+          }
+          break;
+        }
+        default:
+          log_warn("Unknown shared memory command %d", command.type);
+      }
+    }
+
     void _thymio2_enable_accelerometer(_thymio2_enable_accelerometer_in *in,
                                        _thymio2_enable_accelerometer_out *out) {
       if (in->id == -1) {
@@ -553,6 +1147,16 @@ class Plugin : public sim::Plugin {
       Aseba::set_address(in->address);
     }
 
+    void configure_io_thread(configure_io_thread_in *in, configure_io_thread_out *out) {
+      Aseba::configure_io_thread(in->enabled, in->capacity > 0 ? in->capacity : 1);
+    }
+
+    void configure_outbound_queue(configure_outbound_queue_in *in,
+                                  configure_outbound_queue_out *out) {
+      out->success =
+          Aseba::configure_outbound_queue(in->policy, in->capacity > 0 ? in->capacity : 1);
+    }
+
     void _thymio2_set_battery_voltage(_thymio2_set_battery_voltage_in *in,
                                       _thymio2_set_battery_voltage_out *out) {
       if (thymios.count(in->id)) {
@@ -727,6 +1331,22 @@ class Plugin : public sim::Plugin {
   std::set<int> standalone_epucks;
   std::map<int, std::pair<int, unsigned>> buttons;
   std::map<int, int> prox_comm_tx;
+  // incremented when robots are added or removed
+  unsigned robots_version = 0;
+  RobotSelection<CS::Thymio2> selected_thymios;
+  RobotSelection<CS::EPuck> selected_epucks;
+  // reused between steps
+  std::vector<float> observations;
+  StateMirror state_mirror;
+  CommandRing command_ring;
+  CameraExport camera_export;
+  VariableWatches watches;
+  DeferredCalls deferred_calls;
+  // when empty, changes are queued until `get_watched_changes`
+  std::string watch_callback;
+  int watch_script_id = -1;
+  // counted from 1 since the simulation started
+  uint64_t simulation_step = 0;
 };
 
 
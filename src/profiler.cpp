@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+
+#include "logging.h"
+#include "profiler.h"
+
+#ifdef ASEBA_PROFILING_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Log-linear buckets: 4 per power of two, i.e., within 25% of the actual value
+static constexpr unsigned sub_buckets = 4;
+static constexpr unsigned number_of_buckets = 64 * sub_buckets;
+
+struct Histogram {
+  std::array<uint64_t, number_of_buckets> buckets;
+  uint64_t count;
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+};
+
+static const char * phase_names[] = {"step",     "standalone_robots", "prox_comm",
+                                     "spin",     "dashel",            "sensing",
+                                     "vm",       "actuation",         "textures"};
+static std::array<Histogram, size_t(ProfilePhase::COUNT)> histograms;
+static unsigned log_period = 0;
+static unsigned steps = 0;
+
+static uint64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+#ifdef ASEBA_PROFILING_RDTSC
+// NOTE(Jerome): the frequency of the counter is estimated from the elapsed time
+// since the profiler was configured, instead of blocking to calibrate it.
+static uint64_t tsc_origin = 0;
+static uint64_t ns_origin = 0;
+
+uint64_t Profiler::now() { return __rdtsc(); }
+
+static double ticks_per_us() {
+  const uint64_t ns = steady_ns() - ns_origin;
+  if (!ns) return 1000.0;
+  return double(__rdtsc() - tsc_origin) / ns * 1000.0;
+}
+#else
+uint64_t Profiler::now() { return steady_ns(); }
+
+static double ticks_per_us() { return 1000.0; }
+#endif
+
+static unsigned bucket(uint64_t ticks) {
+  if (ticks < sub_buckets) return ticks;
+  unsigned exponent = 2;
+  while (ticks >> (exponent + 1)) exponent++;
+  const unsigned mantissa = (ticks >> (exponent - 2)) & (sub_buckets - 1);
+  return std::min(exponent * sub_buckets + mantissa, number_of_buckets - 1);
+}
+
+static uint64_t bucket_value(unsigned index) {
+  if (index < sub_buckets) return index;
+  const unsigned exponent = index / sub_buckets;
+  return (uint64_t(sub_buckets + index % sub_buckets)) << (exponent - 2);
+}
+
+void Profiler::record(ProfilePhase phase, uint64_t ticks) {
+  Histogram & h = histograms[size_t(phase)];
+  h.buckets[bucket(ticks)]++;
+  if (!h.count || ticks < h.min) h.min = ticks;
+  if (ticks > h.max) h.max = ticks;
+  h.count++;
+  h.total += ticks;
+}
+
+void Profiler::configure(bool value, unsigned period) {
+#ifdef ASEBA_PROFILING_RDTSC
+  if (value && !enabled) {
+    tsc_origin = __rdtsc();
+    ns_origin = steady_ns();
+  }
+#endif
+  enabled = value;
+  log_period = period;
+  steps = 0;
+}
+
+void Profiler::reset() {
+  histograms = {};
+}
+
+std::vector<Profiler::Summary> Profiler::summary() {
+  const double scale = 1.0 / ticks_per_us();
+  std::vector<Summary> summaries;
+  for (size_t i = 0; i < histograms.size(); i++) {
+    const Histogram & h = histograms[i];
+    Summary s{phase_names[i], h.count, 0, 0, 0, 0};
+    if (h.count) {
+      const uint64_t rank = h.count - h.count / 100;
+      uint64_t seen = 0;
+      unsigned b = 0;
+      for (; b < number_of_buckets; b++) {
+        seen += h.buckets[b];
+        if (seen >= rank) break;
+      }
+      s.min = h.min * scale;
+      s.mean = double(h.total) / h.count * scale;
+      // the upper bound of the bucket
+      s.p99 = std::clamp(bucket_value(b + 1) - 1, h.min, h.max) * scale;
+      s.max = h.max * scale;
+    }
+    summaries.push_back(s);
+  }
+  return summaries;
+}
+
+void Profiler::end_step() {
+  if (!enabled || !log_period || ++steps < log_period) return;
+  steps = 0;
+  std::string line;
+  char item[96];
+  for (const auto & s : summary()) {
+    if (!s.count) continue;
+    snprintf(item, sizeof(item), " %s %.1f/%.1f/%.1f", s.phase.c_str(), s.mean, s.p99, s.max);
+    line += item;
+  }
+  log_info("Profile (us, mean/p99/max):%s", line.c_str());
+}
@@ -0,0 +1,106 @@
+#include <cstring>
+
+#include "shared_memory.h"
+#include "logging.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+
+uint64_t SharedMemory::load_acquire(const uint64_t * value) {
+  uint64_t v = *reinterpret_cast<const volatile uint64_t *>(value);
+  MemoryBarrier();
+  return v;
+}
+
+void SharedMemory::store_release(uint64_t * target, uint64_t value) {
+  MemoryBarrier();
+  *reinterpret_cast<volatile uint64_t *>(target) = value;
+}
+
+void SharedMemory::fence_release() { MemoryBarrier(); }
+
+#else
+
+uint64_t SharedMemory::load_acquire(const uint64_t * value) {
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void SharedMemory::store_release(uint64_t * target, uint64_t value) {
+  __atomic_store_n(target, value, __ATOMIC_RELEASE);
+}
+
+void SharedMemory::fence_release() { __atomic_thread_fence(__ATOMIC_RELEASE); }
+
+#endif
+
+SharedMemory::SharedMemory(const std::string & name_, char * memory_, size_t size_,
+                           void * handle_)
+    : name(name_), memory(memory_), length(size_), handle(handle_) {}
+
+#ifdef _WIN32
+
+std::unique_ptr<SharedMemory> SharedMemory::create(const std::string & name, size_t size) {
+  HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                      (DWORD)((uint64_t)size >> 32), (DWORD)size,
+                                      name.c_str());
+  if (!mapping) {
+    log_warn("Failed to create shared memory %s", name.c_str());
+    return nullptr;
+  }
+  char * memory = static_cast<char *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+  if (!memory) {
+    log_warn("Failed to map shared memory %s", name.c_str());
+    CloseHandle(mapping);
+    return nullptr;
+  }
+  memset(memory, 0, size);
+  return std::unique_ptr<SharedMemory>(new SharedMemory(name, memory, size, mapping));
+}
+
+SharedMemory::~SharedMemory() {
+  UnmapViewOfFile(memory);
+  CloseHandle(static_cast<HANDLE>(handle));
+}
+
+#else
+
+std::unique_ptr<SharedMemory> SharedMemory::create(const std::string & name, size_t size) {
+  const std::string path = "/" + name;
+  // NOTE(Jerome): remove any stale region left by a previous session
+  shm_unlink(path.c_str());
+  int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    log_warn("Failed to create shared memory %s", name.c_str());
+    return nullptr;
+  }
+  if (ftruncate(fd, size) < 0) {
+    log_warn("Failed to resize shared memory %s", name.c_str());
+    close(fd);
+    shm_unlink(path.c_str());
+    return nullptr;
+  }
+  // zero initialized by ftruncate
+  void * memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    log_warn("Failed to map shared memory %s", name.c_str());
+    shm_unlink(path.c_str());
+    return nullptr;
+  }
+  return std::unique_ptr<SharedMemory>(
+      new SharedMemory(name, static_cast<char *>(memory), size, nullptr));
+}
+
+SharedMemory::~SharedMemory() {
+  munmap(memory, length);
+  shm_unlink(("/" + name).c_str());
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cstring>
+
+#include "aseba_network.h"
+#include "logging.h"
+#include "state_mirror.h"
+
+static size_t aligned(size_t size, size_t alignment = 64) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+bool StateMirror::open(const std::string & name, unsigned max_robots,
+                       const std::vector<std::string> & variables,
+                       const std::vector<int> & sizes) {
+  close();
+  if (variables.size() > ASEBA_SHM_MAX_VARIABLES) {
+    log_warn("Cannot share more than %d variables", ASEBA_SHM_MAX_VARIABLES);
+    return false;
+  }
+  unsigned variables_size = 0;
+  for (size_t i = 0; i < variables.size(); i++) {
+    variables_size += i < sizes.size() ? std::max(sizes[i], 0) : 1;
+  }
+  const size_t robot_stride =
+      aligned(sizeof(aseba_shm_robot_t) + variables_size * sizeof(int16_t), 8);
+  const size_t buffer_size = aligned(sizeof(aseba_shm_frame_t) + max_robots * robot_stride);
+  const size_t header_size = aligned(sizeof(aseba_shm_header_t));
+  memory = SharedMemory::create(name, header_size + 2 * buffer_size);
+  if (!memory) return false;
+  header = reinterpret_cast<aseba_shm_header_t *>(memory->data());
+  header->version = ASEBA_SHM_VERSION;
+  header->max_robots = max_robots;
+  header->number_of_variables = variables.size();
+  header->variables_size = variables_size;
+  header->robot_stride = robot_stride;
+  header->buffer_size = buffer_size;
+  header->buffer_offset[0] = header_size;
+  header->buffer_offset[1] = header_size + buffer_size;
+  unsigned offset = 0;
+  for (size_t i = 0; i < variables.size(); i++) {
+    aseba_shm_variable_t & variable = header->variables[i];
+    strncpy(variable.name, variables[i].c_str(), ASEBA_SHM_NAME_SIZE - 1);
+    variable.offset = offset;
+    variable.size = i < sizes.size() ? std::max(sizes[i], 0) : 1;
+    offset += variable.size;
+  }
+  sequence = 0;
+  node_variables.clear();
+  // NOTE(Jerome): set last, so that readers never see a partial header
+  SharedMemory::fence_release();
+  header->magic = ASEBA_SHM_MAGIC;
+  log_info("Sharing the state of up to %u robots in %s (%zu bytes)", max_robots,
+           name.c_str(), memory->size());
+  return true;
+}
+
+void StateMirror::close() {
+  memory.reset();
+  header = nullptr;
+}
+
+aseba_shm_robot_t * StateMirror::record(aseba_shm_frame_t * frame, unsigned index) const {
+  return reinterpret_cast<aseba_shm_robot_t *>(reinterpret_cast<char *>(frame + 1) +
+                                               index * header->robot_stride);
+}
+
+void StateMirror::write_variables(int uid, int16_t * values) {
+  std::fill(values, values + header->variables_size, 0);
+  DynamicAsebaNode * node = Aseba::node_with_handle(uid);
+  if (!node) return;
+  NodeVariables & cached = node_variables[uid];
+  if (cached.descriptions != node->descriptions) {
+    cached.descriptions = node->descriptions;
+    cached.locations.clear();
+    for (unsigned i = 0; i < header->number_of_variables; i++) {
+      const aseba_shm_variable_t & variable = header->variables[i];
+      const auto & named = node->descriptions->named_variable;
+      auto it = named.find(variable.name);
+      if (it == named.end()) {
+        cached.locations.emplace_back(0, 0);
+      } else {
+        cached.locations.emplace_back(it->second.first,
+                                      std::min(it->second.second, variable.size));
+      }
+    }
+  }
+  for (unsigned i = 0; i < header->number_of_variables; i++) {
+    const auto & [offset, size] = cached.locations[i];
+    std::copy(node->vm.variables + offset, node->vm.variables + offset + size,
+              values + header->variables[i].offset);
+  }
+}
+
+static void write_robot(aseba_shm_robot_t & r, const CS::Robot & robot) {
+  robot.get_pose(r.position, r.orientation);
+  for (size_t i = 0; i < 2; i++) r.wheel_speed[i] = robot.get_speed(i);
+  for (size_t i = 0; i < 8; i++) r.proximity[i] = robot.get_proximity_value(i);
+  for (size_t i = 0; i < 3; i++) r.ground[i] = robot.get_ground_reflected(i);
+  for (size_t i = 0; i < 3; i++) r.acceleration[i] = robot.get_acceleration(i);
+}
+
+void StateMirror::publish(const std::map<int, CS::Thymio2> & thymios,
+                          const std::map<int, CS::EPuck> & epucks, uint64_t simulation_step,
+                          double time) {
+  if (!header) return;
+  sequence++;
+  header->writing = sequence;
+  SharedMemory::fence_release();
+  aseba_shm_frame_t * frame =
+      reinterpret_cast<aseba_shm_frame_t *>(memory->data() + header->buffer_offset[sequence % 2]);
+  unsigned index = 0;
+  for (const auto & [uid, thymio] : thymios) {
+    if (index == header->max_robots) break;
+    aseba_shm_robot_t & r = *record(frame, index++);
+    r.id = uid;
+    r.type = ASEBA_SHM_THYMIO2;
+    write_robot(r, thymio);
+    r.leds = 0;
+    for (size_t i = 0; i < CS::LED::COUNT && i < 32; i++) {
+      if (thymio.get_led_intensity(i) > 0) r.leds |= 1u << i;
+    }
+    for (size_t i = 0; i < 3; i++) r.led_rgb[i] = thymio.get_led_channel(CS::LED::TOP, i);
+    write_variables(uid, reinterpret_cast<int16_t *>(&r + 1));
+  }
+  for (const auto & [uid, epuck] : epucks) {
+    if (index == header->max_robots) break;
+    aseba_shm_robot_t & r = *record(frame, index++);
+    r.id = uid;
+    r.type = ASEBA_SHM_EPUCK;
+    write_robot(r, epuck);
+    r.leds = 0;
+    for (size_t i = 0; i < 8; i++) {
+      if (epuck.get_ring_led(i)) r.leds |= 1u << i;
+    }
+    if (epuck.get_body_led()) r.leds |= 1u << 8;
+    if (epuck.get_front_led()) r.leds |= 1u << 9;
+    r.led_rgb[0] = r.led_rgb[2] = 0.0f;
+    r.led_rgb[1] = epuck.get_body_led() ? 1.0f : 0.0f;
+    write_variables(uid, reinterpret_cast<int16_t *>(&r + 1));
+  }
+  frame->step = simulation_step;
+  frame->time = time;
+  frame->number_of_robots = index;
+  SharedMemory::store_release(&header->sequence, sequence);
+}
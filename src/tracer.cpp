@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "logging.h"
+#include "tracer.h"
+
+namespace {
+
+struct TraceEvent {
+  const char * name;
+  int id;
+  int arg;
+  uint64_t begin;
+  uint64_t end;
+};
+
+struct TraceBuffer {
+  unsigned thread;
+  unsigned generation;
+  std::vector<TraceEvent> events;
+  // the number of events recorded since the last start
+  uint64_t written;
+};
+
+std::mutex buffers_mutex;
+// a buffer is never removed, so that threads can keep a pointer to theirs
+std::vector<std::unique_ptr<TraceBuffer>> buffers;
+std::atomic<unsigned> generation{0};
+std::atomic<size_t> capacity{0};
+uint64_t origin = 0;
+
+TraceBuffer * local_buffer() {
+  thread_local TraceBuffer * buffer = nullptr;
+  if (!buffer) {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffers.push_back(std::make_unique<TraceBuffer>());
+    buffer = buffers.back().get();
+    buffer->thread = buffers.size();
+    buffer->generation = generation.load() - 1;
+  }
+  // NOTE(Jerome): each thread resets its own ring at the first event after a start
+  if (buffer->generation != generation.load(std::memory_order_relaxed)) {
+    buffer->generation = generation.load(std::memory_order_relaxed);
+    buffer->events.resize(capacity.load(std::memory_order_relaxed));
+    buffer->written = 0;
+  }
+  return buffer;
+}
+
+}  // namespace
+
+uint64_t Tracer::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Tracer::record(const char * name, int id, int arg, uint64_t begin, uint64_t end) {
+  TraceBuffer * buffer = local_buffer();
+  if (buffer->events.empty()) return;
+  buffer->events[buffer->written % buffer->events.size()] = {name, id, arg, begin, end};
+  buffer->written++;
+}
+
+void Tracer::start(size_t value) {
+  capacity = std::max<size_t>(value, 1);
+  origin = now();
+  generation++;
+  enabled = true;
+  log_info("Started tracing (%zu events per thread)", capacity.load());
+}
+
+void Tracer::stop() {
+  enabled = false;
+}
+
+long Tracer::dump(const std::string & path) {
+  FILE * file = fopen(path.c_str(), "w");
+  if (!file) {
+    log_error("Cannot write trace to %s", path.c_str());
+    return -1;
+  }
+  long number = 0;
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  for (const auto & buffer : buffers) {
+    if (buffer->generation != generation) continue;
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"name\":\"thread %u\"}}", number ? ",\n" : "", buffer->thread,
+            buffer->thread);
+    number++;
+    const size_t size = buffer->events.size();
+    const uint64_t first = buffer->written > size ? buffer->written - size : 0;
+    for (uint64_t i = first; i < buffer->written; i++) {
+      const TraceEvent & e = buffer->events[i % size];
+      if (e.begin < origin) continue;
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+              "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%d,\"arg\":%d}}",
+              e.name, buffer->thread, (e.begin - origin) * 1e-3, (e.end - e.begin) * 1e-3,
+              e.id, e.arg);
+      number++;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  const bool ok = fclose(file) == 0;
+  if (!ok) return -1;
+  log_info("Written %ld trace events to %s", number, path.c_str());
+  return number;
+}
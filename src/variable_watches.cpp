@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cstring>
+
+#include "aseba_network.h"
+#include "logging.h"
+#include "variable_watches.h"
+
+int VariableWatches::add(int node_id, unsigned variable_handle, unsigned start, int size) {
+  DynamicAsebaNode * node = Aseba::node_with_handle(node_id);
+  if (!node) return -1;
+  auto [address, variable_size] = node->variable_with_handle(variable_handle);
+  if (start >= variable_size) return -1;
+  const unsigned length =
+      size < 0 ? variable_size - start : std::min<unsigned>(size, variable_size - start);
+  if (!length) return -1;
+  const size_t offset = slab.size();
+  slab.insert(slab.end(), address + start, address + start + length);
+  nodes[node_id].push_back({next_id, variable_handle, start, length, offset});
+  return next_id++;
+}
+
+bool VariableWatches::remove(int watch) {
+  for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+    auto & node_watches = it->second;
+    auto w = std::find_if(node_watches.begin(), node_watches.end(),
+                          [watch](const Watch & w) { return w.id == watch; });
+    if (w == node_watches.end()) continue;
+    node_watches.erase(w);
+    if (node_watches.empty()) nodes.erase(it);
+    compact();
+    return true;
+  }
+  return false;
+}
+
+void VariableWatches::remove_node(int node_id) {
+  if (nodes.erase(node_id)) compact();
+}
+
+void VariableWatches::clear() {
+  nodes.clear();
+  slab.clear();
+  clear_changes();
+}
+
+void VariableWatches::compact() {
+  std::vector<int16_t> previous;
+  previous.swap(slab);
+  for (auto & [_, node_watches] : nodes) {
+    for (auto & w : node_watches) {
+      const size_t offset = slab.size();
+      slab.insert(slab.end(), previous.begin() + w.offset,
+                  previous.begin() + w.offset + w.size);
+      w.offset = offset;
+    }
+  }
+}
+
+void VariableWatches::check() {
+  for (auto & [node_id, node_watches] : nodes) {
+    DynamicAsebaNode * node = Aseba::node_with_handle(node_id);
+    if (!node) continue;
+    for (const auto & w : node_watches) {
+      auto [address, size] = node->variable_with_handle(w.handle);
+      // the description of the node may have changed since the watch was added
+      if (w.start + w.size > size) continue;
+      const int16_t * current = address + w.start;
+      int16_t * previous = slab.data() + w.offset;
+      if (!memcmp(current, previous, w.size * sizeof(int16_t))) continue;
+      if (watches.size() >= capacity) {
+        // keep the previous value, so that the change is reported once there is room
+        if (!overflow) log_warn("Too many pending changes of watched variables: delaying some");
+        overflow = true;
+        continue;
+      }
+      std::copy_n(current, w.size, previous);
+      watches.push_back(w.id);
+      sizes.push_back(w.size);
+      values.insert(values.end(), current, current + w.size);
+    }
+  }
+}
+
+void VariableWatches::clear_changes() {
+  watches.clear();
+  sizes.clear();
+  values.clear();
+  overflow = false;
+}